@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+# Generates a C header of line height, ascender and descender for each font
+# resource in package.json, so layout maths can use exact values instead of
+# hand tuned guesses.
+#
+# Line height is the font's own line spacing from its hhea table (or OS/2,
+# if the font asks for its typo metrics to be used): ascent plus descent plus
+# line gap, scaled to the pixel size. Ascender and descender are measured from
+# only the glyphs a resource actually bundles (its characterRegex), since
+# that's all Pebble will draw with it. Needs fontTools:
+#   pip install fonttools
+#
+# Usage: python scripts/font-metrics.py package.json resources src/c/generated/font-metrics.h [NAME,...]
+# With a list of resource names, only those are measured; the build passes
+# the ones that survive pruning.
+import json
+import math
+import re
+import sys
+
+from fontTools.pens.boundsPen import BoundsPen
+from fontTools.ttLib import TTFont
+
+
+def font_resources(package, names=None):
+    for media in package['pebble']['resources']['media']:
+        if media['type'] != 'font' or (names is not None and media['name'] not in names):
+            continue
+        # Pebble takes the pixel size from the end of the resource name
+        size = re.search(r'_(\d+)$', media['name'])
+        if not size:
+            continue
+        yield media, int(size.group(1))
+
+
+USE_TYPO_METRICS = 1 << 7
+
+
+def line_spacing(font):
+    """
+    Ascent, descent and line gap in font units, as the font asks to be laid out
+    """
+    os2 = font['OS/2'] if 'OS/2' in font else None
+    if os2 is not None and (os2.fsSelection & USE_TYPO_METRICS or 'hhea' not in font):
+        return os2.sTypoAscender, -os2.sTypoDescender, os2.sTypoLineGap
+    hhea = font['hhea']
+    return hhea.ascent, -hhea.descent, hhea.lineGap
+
+
+def metrics(path, size, character_regex):
+    font = TTFont(path)
+    scale = float(size) / font['head'].unitsPerEm
+    glyphs = font.getGlyphSet()
+    pattern = re.compile(character_regex) if character_regex else None
+
+    top, bottom, count = 0, 0, 0
+    for codepoint, name in font.getBestCmap().items():
+        if pattern and not pattern.match(unichr(codepoint) if sys.version_info[0] < 3 else chr(codepoint)):
+            continue
+        pen = BoundsPen(glyphs)
+        glyphs[name].draw(pen)
+        if pen.bounds:
+            top = max(top, pen.bounds[3])
+            bottom = min(bottom, pen.bounds[1])
+        count += 1
+
+    # Ascender and descender are the tallest and deepest of the glyphs we bundle
+    ascent, descent, line_gap = line_spacing(font)
+    return {
+        'LINE_HEIGHT': int(round((ascent + descent + line_gap) * scale)),
+        'ASCENDER': int(math.ceil(top * scale)),
+        'DESCENDER': int(math.ceil(-bottom * scale)),
+        'GLYPHS': count,
+    }
+
+
+def main(package_path, resources_dir, header_path, names=None):
+    with open(package_path) as f:
+        package = json.load(f)
+    if names is not None:
+        names = set(name for name in names.split(',') if name)
+
+    lines = [
+        '#pragma once',
+        '',
+        '// Generated by scripts/font-metrics.py from package.json; do not edit',
+        '',
+    ]
+    for media, size in font_resources(package, names):
+        values = metrics('{}/{}'.format(resources_dir, media['file']), size, media.get('characterRegex'))
+        for key in ('LINE_HEIGHT', 'ASCENDER', 'DESCENDER', 'GLYPHS'):
+            lines.append('#define {}_{} {}'.format(media['name'], key, values[key]))
+        lines.append('')
+
+    with open(header_path, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main(*sys.argv[1:])
@@ -0,0 +1,139 @@
+#!/usr/bin/env python
+# Turns trace dumps recorded on a watch into per-day activity numbers, so a
+# change that makes the watchface busier shows up before the battery does.
+#
+# Record a session by leaving `pebble logs` running while the watchface is in
+# use, with TRACE_ON_READY set in src/pkjs/index.js (or calling requestTrace
+# from time to time). Each dump is logged as a "trace-record" line; dumps
+# overlap, since the ring on the watch is only TRACE_SIZE events, and the
+# overlap is dropped here. Counts are scaled up to a full day from the time the
+# dumps cover: each dump covers its first to its last event, and the gaps
+# between dumps, whose events were lost, don't count.
+#
+# Usage: python scripts/trace-report.py session.log [--json report.json] [--baseline old.json]
+# With --baseline, any count more than 10% above the baseline is reported and
+# the script exits with status 1.
+import argparse
+import binascii
+import json
+import re
+import struct
+import sys
+
+# Must match TraceEventId in src/c/trace.h
+EVENT_NAMES = [None, 'STATE_ENTER', 'STATE_TIMER', 'PAGE', 'TICK', 'POEM_REQUEST',
+               'POEM_CHUNK', 'POEM_SET', 'INBOX_DROPPED', 'OUTBOX_FAILED', 'PAGE_TRANSITION',
+               'POWER_LEVEL', 'VISIBILITY', 'POEM_UNCHANGED', 'INBOX']
+
+RECORD = re.compile(r'trace-record ([0-9a-f]*)')
+DAY_MS = 24 * 60 * 60 * 1000
+REGRESSION = 1.10
+
+
+def read_events(log):
+    """
+    (time, name, arg) for every distinct event in the log, oldest first, and
+    the (first, last) times of each dump
+    """
+    events = set()
+    dumps = []
+    for line in log:
+        match = RECORD.search(line)
+        if not match:
+            continue
+        data = binascii.unhexlify(match.group(1))
+        times = []
+        for offset in range(0, len(data) - 7, 8):
+            time, event_id, _, arg = struct.unpack_from('<IBBH', data, offset)
+            name = EVENT_NAMES[event_id] if event_id < len(EVENT_NAMES) else str(event_id)
+            events.add((time, name, arg))
+            times.append(time)
+        if times:
+            dumps.append((min(times), max(times)))
+    return sorted(events), dumps
+
+
+def covered(dumps):
+    """
+    Milliseconds covered by at least one dump, counting overlaps once
+    """
+    total = 0
+    end = None
+    for first, last in sorted(dumps):
+        if end is None or first > end:
+            total += last - first
+            end = last
+        elif last > end:
+            total += last - end
+            end = last
+    return total
+
+
+def report(events, dumps):
+    """
+    Activity per simulated day
+    """
+    span = covered(dumps)
+    counts = {}
+    for time, name, arg in events:
+        counts[name] = counts.get(name, 0) + 1
+
+    frames = sum(arg for _, name, arg in events if name == 'PAGE_TRANSITION')
+    inbox_bytes = sum(arg for _, name, arg in events if name == 'INBOX')
+
+    # Every state timer and transition frame is a wakeup on top of the minute tick
+    totals = {
+        'wakeups': counts.get('STATE_TIMER', 0) + counts.get('TICK', 0) + frames,
+        'timer registrations': counts.get('STATE_ENTER', 0) + counts.get('PAGE', 0) + frames,
+        'page turns': counts.get('PAGE', 0),
+        'transition frames': frames,
+        'layouts': counts.get('POEM_SET', 0),
+        'poem requests': counts.get('POEM_REQUEST', 0),
+        'unchanged replies': counts.get('POEM_UNCHANGED', 0),
+        'messages received': counts.get('INBOX', 0),
+        'bytes received': inbox_bytes,
+        'messages dropped': counts.get('INBOX_DROPPED', 0),
+        'sends failed': counts.get('OUTBOX_FAILED', 0),
+    }
+
+    scale = float(DAY_MS) / span if span > 0 else 0
+    return {
+        'events': len(events),
+        'hours covered': round(span / 3600000.0, 2),
+        'per day': dict((name, int(round(value * scale))) for name, value in totals.items()),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-day activity from recorded watch traces')
+    parser.add_argument('log', type=argparse.FileType('r'))
+    parser.add_argument('--json', help='write the report here as well')
+    parser.add_argument('--baseline', help='report from an earlier build to compare against')
+    args = parser.parse_args()
+
+    events, dumps = read_events(args.log)
+    if not events:
+        sys.exit('No trace-record lines in {}'.format(args.log.name))
+    result = report(events, dumps)
+
+    print('{} events over {} hours'.format(result['events'], result['hours covered']))
+    for name in sorted(result['per day']):
+        print('{:<22} {:>8} per day'.format(name, result['per day'][name]))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)['per day']
+        regressions = [name for name, value in result['per day'].items()
+                       if value > baseline.get(name, 0) * REGRESSION and value - baseline.get(name, 0) > 1]
+        for name in sorted(regressions):
+            print('REGRESSION {}: {} per day, was {}'.format(name, result['per day'][name], baseline[name] if name in baseline else 0))
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,82 @@
+#include "diagnostics.h"
+
+#if SAT_DIAGNOSTICS
+
+typedef struct {
+    uint16_t count;
+    uint16_t max_ms;
+    uint32_t total_ms;
+} DiagnosticsTiming;
+
+// Packed as sent to the phone, little endian
+typedef struct {
+    uint32_t heap_used_max;
+    uint32_t heap_free_min;
+    DiagnosticsTiming timings[DIAG_COUNT];
+} DiagnosticsReport;
+
+// heap_free_min of 0 means we haven't sampled the heap yet
+static DiagnosticsReport s_report;
+
+/*
+ * Milliseconds on a clock good enough for timing things that take less than a minute
+ */
+uint32_t diagnostics_clock(void) {
+    time_t seconds;
+    uint16_t ms;
+    time_ms(&seconds, &ms);
+    return (uint32_t)seconds * 1000 + ms;
+}
+
+/*
+ * Note that an operation which started at start has just finished
+ */
+void diagnostics_record(DiagnosticsTimer timer, uint32_t start) {
+    diagnostics_record_ms(timer, diagnostics_clock() - start);
+}
+
+/*
+ * Note an operation that took elapsed milliseconds, for work spread over several calls
+ */
+void diagnostics_record_ms(DiagnosticsTimer timer, uint32_t elapsed) {
+    DiagnosticsTiming *timing = &s_report.timings[timer];
+
+    timing->count++;
+    timing->total_ms += elapsed;
+    if (elapsed > timing->max_ms) {
+        timing->max_ms = elapsed > UINT16_MAX ? UINT16_MAX : elapsed;
+    }
+
+    diagnostics_sample_heap();
+}
+
+void diagnostics_sample_heap(void) {
+    uint32_t used = heap_bytes_used();
+    uint32_t free = heap_bytes_free();
+
+    if (used > s_report.heap_used_max) {
+        s_report.heap_used_max = used;
+    }
+    if (free < s_report.heap_free_min || s_report.heap_free_min == 0) {
+        s_report.heap_free_min = free;
+    }
+}
+
+/*
+ * Send what we have to the phone and start counting again
+ */
+bool diagnostics_send(void) {
+    diagnostics_sample_heap();
+
+    DictionaryIterator *iter;
+    if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+        return false;
+    }
+    dict_write_data(iter, MESSAGE_KEY_DIAGNOSTICS, (const uint8_t *)&s_report, sizeof(s_report));
+    app_message_outbox_send();
+
+    memset(&s_report, 0, sizeof(s_report));
+    return true;
+}
+
+#endif
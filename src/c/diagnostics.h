@@ -0,0 +1,41 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Heap and timing diagnostics, reported to the phone
+ *
+ * We keep the high-water mark of heap use, the low-water mark of free heap
+ * and, for a few expensive operations, how often they ran and how long they
+ * took. Every hour the lot goes to the phone in a single DIAGNOSTICS message
+ * and the counters start again. Build with SAT_DIAGNOSTICS=0 to compile it
+ * all out.
+ */
+
+#ifndef SAT_DIAGNOSTICS
+#define SAT_DIAGNOSTICS 1
+#endif
+
+#define DIAGNOSTICS_MINUTE 35 // minute past the hour to report, away from poem refreshes
+
+typedef enum {
+    DIAG_POEM_LAYOUT = 0,
+    DIAG_PAGE_DRAW,
+    DIAG_WINDOW_LOAD,
+    DIAG_PAGE_TRANSITION, // drawing time summed over a transition's frames
+    DIAG_COUNT
+} DiagnosticsTimer;
+
+#if SAT_DIAGNOSTICS
+uint32_t diagnostics_clock(void);
+void diagnostics_record(DiagnosticsTimer timer, uint32_t start);
+void diagnostics_record_ms(DiagnosticsTimer timer, uint32_t elapsed);
+void diagnostics_sample_heap(void);
+bool diagnostics_send(void);
+#else
+#define diagnostics_clock() 0
+#define diagnostics_record(timer, start) ((void)(start))
+#define diagnostics_record_ms(timer, elapsed) ((void)(elapsed))
+#define diagnostics_sample_heap()
+#define diagnostics_send() false
+#endif
@@ -0,0 +1,59 @@
+#include "font-cache.h"
+#include "logging.h"
+
+typedef struct {
+    uint32_t resource_id;
+    GFont font;
+    uint8_t refs; // 0 for an unused entry
+} FontCacheEntry;
+
+static FontCacheEntry s_fonts[FONT_CACHE_SIZE];
+
+/*
+ * Load a font, or share the one already loaded for this resource
+ */
+GFont font_cache_get(uint32_t resource_id) {
+    FontCacheEntry *free_entry = NULL;
+
+    for (int i = 0; i < FONT_CACHE_SIZE; i++) {
+        FontCacheEntry *entry = &s_fonts[i];
+        if (entry->refs > 0 && entry->resource_id == resource_id) {
+            entry->refs++;
+            return entry->font;
+        }
+        if (entry->refs == 0 && !free_entry) {
+            free_entry = entry;
+        }
+    }
+
+    GFont font = fonts_load_custom_font(resource_get_handle(resource_id));
+    if (!free_entry) {
+        // Out of entries; hand it out uncached rather than fail
+        LOG_ERROR("Font cache full, loading font %d uncached", (int)resource_id);
+        return font;
+    }
+
+    free_entry->resource_id = resource_id;
+    free_entry->font = font;
+    free_entry->refs = 1;
+    return font;
+}
+
+/*
+ * Let go of a font, unloading it once nobody is using it
+ */
+void font_cache_release(GFont font) {
+    for (int i = 0; i < FONT_CACHE_SIZE; i++) {
+        FontCacheEntry *entry = &s_fonts[i];
+        if (entry->refs > 0 && entry->font == font) {
+            if (--entry->refs == 0) {
+                fonts_unload_custom_font(entry->font);
+                entry->font = NULL;
+            }
+            return;
+        }
+    }
+
+    // Not one of ours, so it must have been loaded uncached
+    fonts_unload_custom_font(font);
+}
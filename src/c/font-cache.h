@@ -0,0 +1,16 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Reference counted custom fonts, keyed by resource id
+ *
+ * Every layer that wants a font gets it from here, so a font used in more
+ * than one place (Charis for both the title and the poem) is only loaded
+ * once. Each font_cache_get needs a matching font_cache_release.
+ */
+
+#define FONT_CACHE_SIZE 4 // distinct fonts loaded at once
+
+GFont font_cache_get(uint32_t resource_id);
+void font_cache_release(GFont font);
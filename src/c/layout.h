@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pebble.h>
+#include "generated/font-metrics.h"
+
+/*
+ * Screen layout, resolved per platform at compile time
+ *
+ * Each target gets one entry below giving its screen size and where the
+ * title, poem and time sit; everything else is derived from those and the
+ * measured poem font, so nothing is worked out at runtime. Supporting a new
+ * platform means adding an entry here.
+ */
+
+#if defined(PBL_PLATFORM_APLITE) || defined(PBL_PLATFORM_BASALT) || defined(PBL_PLATFORM_DIORITE)
+#define LAYOUT_SCREEN_WIDTH 144
+#define LAYOUT_SCREEN_HEIGHT 168
+#define LAYOUT_MARGIN 4 // left and right of all text, in pixels
+#define LAYOUT_POEM_TOP LAYOUT_MARGIN
+#define LAYOUT_TIME_TOP 144
+#define LAYOUT_POEM_ALIGNMENT GTextAlignmentLeft
+#elif defined(PBL_PLATFORM_CHALK)
+#define LAYOUT_SCREEN_WIDTH 180
+#define LAYOUT_SCREEN_HEIGHT 180
+#define LAYOUT_MARGIN 4
+#define LAYOUT_POEM_TOP (LAYOUT_MARGIN + 5)
+#define LAYOUT_TIME_TOP 144
+#define LAYOUT_POEM_ALIGNMENT GTextAlignmentCenter
+#else
+#error "No layout for this platform, add one to layout.h"
+#endif
+
+#define LAYOUT_TEXT_WIDTH (LAYOUT_SCREEN_WIDTH - (2 * LAYOUT_MARGIN))
+
+// Paging, from the measured metrics of the poem font (Charis 24)
+// Need to change along with the poem font in generate_poem_layer
+#define LAYOUT_POEM_LINE_HEIGHT FONT_CHARIS_SIL_24_LINE_HEIGHT // distance between lines, in pixels
+// Lines on screen at once: as many as fit above the time, leaving the last room for its descenders
+#define LAYOUT_POEM_LINES ((LAYOUT_TIME_TOP - LAYOUT_POEM_TOP - FONT_CHARIS_SIL_24_DESCENDER) / LAYOUT_POEM_LINE_HEIGHT)
+#define LAYOUT_POEM_PAGE_HEIGHT (LAYOUT_POEM_LINES * LAYOUT_POEM_LINE_HEIGHT + FONT_CHARIS_SIL_24_DESCENDER)
+
+#if LAYOUT_POEM_LINES < 1
+#error "Poem font too tall for the screen, see layout.h"
+#endif
+
+// Title is centred vertically, three lines as tall as the title font's ascender with a gap
+// Uses the poem font's metrics, as the title shares it
+#define LAYOUT_TITLE_LINES 3
+#define LAYOUT_TITLE_GAP 8
+#define LAYOUT_TITLE_HEIGHT (LAYOUT_TITLE_LINES * FONT_CHARIS_SIL_24_ASCENDER + LAYOUT_TITLE_GAP)
+#define LAYOUT_TIME_HEIGHT 20
+
+#define LAYOUT_TITLE_RECT GRect(LAYOUT_MARGIN, (LAYOUT_SCREEN_HEIGHT - LAYOUT_TITLE_HEIGHT) / 2, LAYOUT_TEXT_WIDTH, LAYOUT_TITLE_HEIGHT)
+#define LAYOUT_POEM_RECT GRect(LAYOUT_MARGIN, LAYOUT_POEM_TOP, LAYOUT_TEXT_WIDTH, LAYOUT_POEM_PAGE_HEIGHT)
+#define LAYOUT_TIME_RECT GRect(LAYOUT_MARGIN, LAYOUT_TIME_TOP, LAYOUT_TEXT_WIDTH, LAYOUT_TIME_HEIGHT)
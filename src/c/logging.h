@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Compile-time log levels
+ *
+ * Anything above SAT_LOG_LEVEL compiles to nothing, so release builds don't
+ * pay for formatting or sending log messages at all. Set SAT_LOG_LEVEL in
+ * the environment when building to change it; see wscript.
+ */
+
+#define SAT_LOG_NONE 0
+#define SAT_LOG_ERROR 1
+#define SAT_LOG_WARNING 2
+#define SAT_LOG_INFO 3
+#define SAT_LOG_DEBUG 4
+
+#ifndef SAT_LOG_LEVEL
+#define SAT_LOG_LEVEL SAT_LOG_WARNING
+#endif
+
+#if SAT_LOG_LEVEL >= SAT_LOG_ERROR
+#define LOG_ERROR(fmt, ...) APP_LOG(APP_LOG_LEVEL_ERROR, fmt, ## __VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...)
+#endif
+
+#if SAT_LOG_LEVEL >= SAT_LOG_WARNING
+#define LOG_WARNING(fmt, ...) APP_LOG(APP_LOG_LEVEL_WARNING, fmt, ## __VA_ARGS__)
+#else
+#define LOG_WARNING(fmt, ...)
+#endif
+
+#if SAT_LOG_LEVEL >= SAT_LOG_INFO
+#define LOG_INFO(fmt, ...) APP_LOG(APP_LOG_LEVEL_INFO, fmt, ## __VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...)
+#endif
+
+#if SAT_LOG_LEVEL >= SAT_LOG_DEBUG
+#define LOG_DEBUG(fmt, ...) APP_LOG(APP_LOG_LEVEL_DEBUG, fmt, ## __VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...)
+#endif
@@ -0,0 +1,230 @@
+#include "poem-cache.h"
+#include "logging.h"
+
+#define KEY_NEWEST POEM_CACHE_PERSIST_KEY
+#define KEYS_PER_SLOT (2 + POEM_CACHE_POEM_BLOCKS)
+#define SLOT_KEY(slot, k) (POEM_CACHE_PERSIST_KEY + 1 + (slot) * KEYS_PER_SLOT + (k))
+
+typedef struct {
+    uint32_t valid_from;
+    uint32_t valid_until; // 0 for an empty slot
+    uint32_t location; // hash of where the poem was written for, from the phone
+    uint16_t title_length;
+    uint16_t poem_length;
+} PoemCacheHeader;
+
+static PoemCacheHeader s_headers[POEM_CACHE_SLOTS];
+static int s_newest = -1;
+
+/*
+ * Read all the slot headers into RAM
+ */
+void poem_cache_init(void) {
+    memset(s_headers, 0, sizeof(s_headers));
+    s_newest = persist_exists(KEY_NEWEST) ? persist_read_int(KEY_NEWEST) : -1;
+
+    for (int slot = 0; slot < POEM_CACHE_SLOTS; slot++) {
+        if (persist_read_data(SLOT_KEY(slot, 0), &s_headers[slot], sizeof(PoemCacheHeader)) != sizeof(PoemCacheHeader) ||
+                s_headers[slot].poem_length > POEM_CACHE_MAX_POEM ||
+                s_headers[slot].title_length > POEM_CACHE_MAX_TITLE) {
+            memset(&s_headers[slot], 0, sizeof(PoemCacheHeader));
+        }
+    }
+
+    if (s_newest < 0 || s_newest >= POEM_CACHE_SLOTS || s_headers[s_newest].valid_until == 0) {
+        s_newest = -1;
+    }
+}
+
+/*
+ * Empty a slot and give back its storage
+ */
+static void clear_slot(int slot) {
+    for (int k = 0; k < KEYS_PER_SLOT; k++) {
+        persist_delete(SLOT_KEY(slot, k));
+    }
+    memset(&s_headers[slot], 0, sizeof(PoemCacheHeader));
+    if (s_newest == slot) {
+        s_newest = -1;
+    }
+}
+
+/*
+ * Write a poem into the slot after the newest one, overwriting the oldest
+ * Returns the slot, or -1 if the poem couldn't be cached
+ */
+int poem_cache_store(const char *title, const char *poem, uint32_t location, time_t valid_from, time_t valid_until) {
+    PoemCacheHeader header = {
+        .valid_from = (uint32_t)valid_from,
+        .valid_until = (uint32_t)valid_until,
+        .location = location,
+        .title_length = strlen(title),
+        .poem_length = strlen(poem)
+    };
+
+    if (header.poem_length > POEM_CACHE_MAX_POEM) {
+        LOG_INFO("Poem too long to cache: %d bytes", (int)header.poem_length);
+        return -1;
+    }
+    if (header.title_length > POEM_CACHE_MAX_TITLE) {
+        // Cut at the start of a character, not part way through one
+        header.title_length = POEM_CACHE_MAX_TITLE;
+        while (header.title_length > 0 && ((uint8_t)title[header.title_length] & 0xC0) == 0x80) {
+            header.title_length--;
+        }
+    }
+
+    int slot = (s_newest + 1) % POEM_CACHE_SLOTS;
+
+    // Mark the slot empty first, so a half written slot is never mistaken for a whole one
+    persist_delete(SLOT_KEY(slot, 0));
+    memset(&s_headers[slot], 0, sizeof(PoemCacheHeader));
+
+    bool written = header.title_length == 0 ||
+            persist_write_data(SLOT_KEY(slot, 1), title, header.title_length) == header.title_length;
+    uint16_t block = 0;
+    for (uint16_t offset = 0; written && offset < header.poem_length; offset += PERSIST_DATA_MAX_LENGTH, block++) {
+        uint16_t size = header.poem_length - offset;
+        if (size > PERSIST_DATA_MAX_LENGTH) {
+            size = PERSIST_DATA_MAX_LENGTH;
+        }
+        written = persist_write_data(SLOT_KEY(slot, 2 + block), poem + offset, size) == size;
+    }
+
+    // Blocks left over from a longer poem only take up storage
+    for (; block < POEM_CACHE_POEM_BLOCKS; block++) {
+        persist_delete(SLOT_KEY(slot, 2 + block));
+    }
+
+    if (!written || persist_write_data(SLOT_KEY(slot, 0), &header, sizeof(header)) != sizeof(header)) {
+        LOG_ERROR("Couldn't write poem cache slot %d", slot);
+        clear_slot(slot);
+        return -1;
+    }
+    s_headers[slot] = header;
+
+    persist_write_int(KEY_NEWEST, slot);
+    s_newest = slot;
+    return slot;
+}
+
+/*
+ * Find the poem for the given time: the most recently started window that
+ * hasn't ended yet. Returns -1 if nothing covers now.
+ */
+int poem_cache_find(time_t now) {
+    int found = -1;
+    for (int slot = 0; slot < POEM_CACHE_SLOTS; slot++) {
+        const PoemCacheHeader *header = &s_headers[slot];
+        if (header->valid_until == 0 || (time_t)header->valid_from > now || (time_t)header->valid_until <= now) {
+            continue;
+        }
+        if (found < 0 || header->valid_from > s_headers[found].valid_from) {
+            found = slot;
+        }
+    }
+    return found;
+}
+
+/*
+ * Slot most recently written, or -1 if the cache is empty
+ */
+int poem_cache_newest(void) {
+    return s_newest;
+}
+
+/*
+ * End of the last window we have a poem for; once we get near this we need a new batch
+ */
+time_t poem_cache_valid_until(void) {
+    uint32_t until = 0;
+    for (int slot = 0; slot < POEM_CACHE_SLOTS; slot++) {
+        if (s_headers[slot].valid_until > until) {
+            until = s_headers[slot].valid_until;
+        }
+    }
+    return (time_t)until;
+}
+
+/*
+ * Read back a cached poem into freshly allocated strings
+ * The caller owns *title and *poem afterwards
+ */
+bool poem_cache_load(int slot, char **title, char **poem) {
+    if (slot < 0 || slot >= POEM_CACHE_SLOTS || s_headers[slot].valid_until == 0) {
+        return false;
+    }
+    const PoemCacheHeader *header = &s_headers[slot];
+
+    *title = malloc(header->title_length + 1);
+    *poem = malloc(header->poem_length + 1);
+    if (!*title || !*poem) {
+        free(*title);
+        free(*poem);
+        return false;
+    }
+
+    bool read = header->title_length == 0 ||
+            persist_read_data(SLOT_KEY(slot, 1), *title, header->title_length) == header->title_length;
+    (*title)[header->title_length] = '\0';
+    for (uint16_t offset = 0, block = 0; read && offset < header->poem_length; offset += PERSIST_DATA_MAX_LENGTH, block++) {
+        uint16_t size = header->poem_length - offset;
+        if (size > PERSIST_DATA_MAX_LENGTH) {
+            size = PERSIST_DATA_MAX_LENGTH;
+        }
+        read = persist_read_data(SLOT_KEY(slot, 2 + block), *poem + offset, size) == size;
+    }
+    (*poem)[header->poem_length] = '\0';
+
+    // Part of the poem is missing, so don't try it again
+    if (!read) {
+        LOG_ERROR("Poem cache slot %d is damaged", slot);
+        free(*title);
+        free(*poem);
+        clear_slot(slot);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Where a slot's poem was written for, or 0 if we don't know or the slot is empty
+ */
+uint32_t poem_cache_location(int slot) {
+    if (slot < 0 || slot >= POEM_CACHE_SLOTS || s_headers[slot].valid_until == 0) {
+        return 0;
+    }
+    return s_headers[slot].location;
+}
+
+/*
+ * We're somewhere else now: empty the slots written for anywhere but location
+ * Slots whose location we don't know are kept
+ */
+void poem_cache_forget_elsewhere(uint32_t location) {
+    for (int slot = 0; slot < POEM_CACHE_SLOTS; slot++) {
+        uint32_t slot_location = poem_cache_location(slot);
+        if (slot_location != 0 && slot_location != location) {
+            LOG_INFO("Forgetting poem cache slot %d from elsewhere", slot);
+            clear_slot(slot);
+        }
+    }
+}
+
+/*
+ * Move the end of a slot's window, for a poem the phone says is still current
+ */
+bool poem_cache_extend(int slot, time_t valid_until) {
+    if (slot < 0 || slot >= POEM_CACHE_SLOTS || s_headers[slot].valid_until == 0) {
+        return false;
+    }
+
+    PoemCacheHeader header = s_headers[slot];
+    header.valid_until = (uint32_t)valid_until;
+    if (persist_write_data(SLOT_KEY(slot, 0), &header, sizeof(header)) != sizeof(header)) {
+        LOG_ERROR("Couldn't extend poem cache slot %d", slot);
+        return false;
+    }
+    s_headers[slot] = header;
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Ring of upcoming poems in persistent storage
+ *
+ * The phone sends a batch of poems, each valid for a window of time (usually
+ * around a satellite's pass), and we switch between them on our own clock.
+ * Keeping them in persistent storage also means we have something to show at
+ * startup without waiting on the phone. Each poem is tagged with a hash of
+ * where it was written for (POEM_LOCATION), so once the phone tells us we've
+ * moved, poems about someone else's sky are dropped.
+ *
+ * Each slot is a header key, a title key and up to POEM_CACHE_POEM_BLOCKS keys
+ * holding the poem itself, since a single persist key holds at most
+ * PERSIST_DATA_MAX_LENGTH bytes. The headers are also kept in RAM so picking
+ * the current poem doesn't touch storage. Poems too long to cache are skipped,
+ * and a slot that can't be written in full is left empty.
+ *
+ * At most POEM_CACHE_SLOTS * (16 + POEM_CACHE_MAX_TITLE + POEM_CACHE_MAX_POEM)
+ * = 2544 bytes, which leaves room in the 4 KB persist budget for sat-predict.h
+ * and timeline.h. The phone sends batches of POEM_CACHE_SLOTS poems.
+ */
+
+#define POEM_CACHE_SLOTS 3
+#define POEM_CACHE_POEM_BLOCKS 3
+#define POEM_CACHE_MAX_POEM (POEM_CACHE_POEM_BLOCKS * PERSIST_DATA_MAX_LENGTH)
+#define POEM_CACHE_MAX_TITLE 64
+
+// Persist keys POEM_CACHE_PERSIST_KEY onwards belong to the cache
+#define POEM_CACHE_PERSIST_KEY 100
+
+void poem_cache_init(void);
+int poem_cache_store(const char *title, const char *poem, uint32_t location, time_t valid_from, time_t valid_until);
+int poem_cache_find(time_t now);
+int poem_cache_newest(void);
+time_t poem_cache_valid_until(void);
+bool poem_cache_load(int slot, char **title, char **poem);
+bool poem_cache_extend(int slot, time_t valid_until);
+uint32_t poem_cache_location(int slot);
+void poem_cache_forget_elsewhere(uint32_t location);
@@ -0,0 +1,94 @@
+#include "poem-chunks.h"
+#include "logging.h"
+#include "poem-codec.h"
+
+#if POEM_MAX_CHUNKS > 32
+#error "POEM_MAX_CHUNKS must fit in the received bitmask"
+#endif
+
+/*
+ * Start assembling a new poem of the given length, dropping any partial one
+ * wire_length is how many bytes will actually be sent, which is less than
+ * length if the poem is encoded
+ */
+bool poem_chunks_begin(PoemChunks *chunks, uint16_t length, uint16_t wire_length) {
+    poem_chunks_reset(chunks);
+
+    if (length == 0 || length > POEM_MAX_LENGTH || wire_length == 0 || wire_length > length) {
+        LOG_ERROR("Poem length out of range: %d (%d on the wire)", (int)length, (int)wire_length);
+        return false;
+    }
+
+    chunks->text = malloc(length + 1);
+    if (!chunks->text) {
+        LOG_ERROR("Not enough memory for poem of %d bytes", (int)length);
+        return false;
+    }
+
+    chunks->text[length] = '\0';
+    chunks->length = length;
+    chunks->wire_offset = length - wire_length;
+    chunks->num_chunks = (wire_length + POEM_CHUNK_SIZE - 1) / POEM_CHUNK_SIZE;
+    return true;
+}
+
+/*
+ * Copy a chunk into place
+ * Returns false if the chunk doesn't belong to the poem we're assembling
+ */
+bool poem_chunks_add(PoemChunks *chunks, uint8_t seq, const uint8_t *data, uint16_t size) {
+    if (!chunks->text || seq >= chunks->num_chunks) {
+        return false;
+    }
+
+    uint16_t offset = chunks->wire_offset + seq * POEM_CHUNK_SIZE;
+    uint16_t expected = chunks->length - offset;
+    if (expected > POEM_CHUNK_SIZE) {
+        expected = POEM_CHUNK_SIZE;
+    }
+    if (size != expected) {
+        LOG_ERROR("Chunk %d has %d bytes, expected %d", (int)seq, (int)size, (int)expected);
+        return false;
+    }
+
+    // Duplicates just get written over with the same bytes
+    memcpy(chunks->text + offset, data, size);
+    chunks->received |= (1u << seq);
+    return true;
+}
+
+bool poem_chunks_complete(const PoemChunks *chunks) {
+    if (!chunks->text) {
+        return false;
+    }
+    uint32_t all = (chunks->num_chunks == 32) ? 0xFFFFFFFFu : ((1u << chunks->num_chunks) - 1);
+    return chunks->received == all;
+}
+
+/*
+ * Hand over the finished text, decoding it first if need be
+ * The caller now owns it and must free it
+ */
+char *poem_chunks_take(PoemChunks *chunks) {
+    if (!poem_chunks_complete(chunks)) {
+        return NULL;
+    }
+    if (chunks->wire_offset > 0 && !poem_codec_decode(chunks->text, chunks->length, chunks->wire_offset)) {
+        LOG_ERROR("Couldn't decode poem");
+        poem_chunks_reset(chunks);
+        return NULL;
+    }
+    char *text = chunks->text;
+    chunks->text = NULL;
+    poem_chunks_reset(chunks);
+    return text;
+}
+
+void poem_chunks_reset(PoemChunks *chunks) {
+    free(chunks->text);
+    chunks->text = NULL;
+    chunks->length = 0;
+    chunks->wire_offset = 0;
+    chunks->num_chunks = 0;
+    chunks->received = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Reassembly of poems that are sent from the phone in sequenced chunks
+ *
+ * The first message of a poem carries POEM_LENGTH (total bytes), and every
+ * message carries POEM_SEQ and a POEM byte array of at most POEM_CHUNK_SIZE
+ * bytes. Chunk n always lands at offset n * POEM_CHUNK_SIZE, so chunks can
+ * arrive in any order once the poem has begun. A poem is only handed over
+ * once every chunk has arrived.
+ *
+ * If the poem was encoded with poem-codec, the header also carries
+ * POEM_WIRE_LENGTH. The encoded bytes are then assembled at the end of the
+ * buffer and decoded in place once the last chunk is in.
+ */
+
+// Must match POEM_CHUNK_SIZE in src/pkjs/index.js
+#define POEM_CHUNK_SIZE 200
+#define POEM_MAX_LENGTH 4096
+#define POEM_MAX_CHUNKS ((POEM_MAX_LENGTH + POEM_CHUNK_SIZE - 1) / POEM_CHUNK_SIZE)
+
+typedef struct {
+    char *text;
+    uint16_t length;
+    uint16_t wire_offset; // where the bytes on the wire start; non-zero if encoded
+    uint8_t num_chunks;
+    uint32_t received; // bitmask of chunks we have so far
+} PoemChunks;
+
+bool poem_chunks_begin(PoemChunks *chunks, uint16_t length, uint16_t wire_length);
+bool poem_chunks_add(PoemChunks *chunks, uint8_t seq, const uint8_t *data, uint16_t size);
+bool poem_chunks_complete(const PoemChunks *chunks);
+char *poem_chunks_take(PoemChunks *chunks);
+void poem_chunks_reset(PoemChunks *chunks);
@@ -0,0 +1,99 @@
+#include "poem-codec.h"
+
+// Must match DICTIONARY in src/pkjs/codec.js, in the same order
+static const char *const s_dictionary[] = {
+    " the ",
+    " and ",
+    " of ",
+    " in ",
+    " at ",
+    " to ",
+    " is ",
+    "satellite",
+    "satellites",
+    "overhead",
+    " orbit",
+    " orbiting",
+    " above",
+    " passing",
+    " passes",
+    " over ",
+    " degrees",
+    " minutes",
+    " seconds",
+    " hours",
+    " kilometers",
+    " miles",
+    "altitude",
+    "azimuth",
+    "elevation",
+    "horizon",
+    " the sky",
+    "north",
+    "south",
+    "east",
+    "west",
+    "northeast",
+    "northwest",
+    "southeast",
+    "southwest",
+    "STARLINK",
+    "COSMOS",
+    "IRIDIUM",
+    "NOAA",
+    "GLOBALSTAR",
+    "ORBCOMM",
+    "FLOCK",
+    "LEMUR",
+    "ONEWEB",
+    " R/B",
+    " DEB",
+    "rocket body",
+    "debris",
+    "launched",
+    " by ",
+    " from ",
+    " with ",
+    "ing ",
+    "ed ",
+    "tion",
+    "\n\n",
+    ", ",
+    ". ",
+};
+
+#define DICTIONARY_SIZE (sizeof(s_dictionary) / sizeof(s_dictionary[0]))
+
+/*
+ * Decode buffer[wire_offset, length) into buffer[0, length) in place
+ * Returns false if the encoded text is malformed or doesn't decode to exactly length bytes
+ */
+bool poem_codec_decode(char *buffer, uint16_t length, uint16_t wire_offset) {
+    uint16_t read = wire_offset;
+    uint16_t write = 0;
+
+    while (read < length) {
+        if ((uint8_t)buffer[read] != POEM_CODEC_TOKEN) {
+            buffer[write++] = buffer[read++];
+            continue;
+        }
+
+        if (read + 1 >= length || (uint8_t)buffer[read + 1] >= DICTIONARY_SIZE) {
+            return false;
+        }
+
+        const char *entry = s_dictionary[(uint8_t)buffer[read + 1]];
+        uint16_t size = strlen(entry);
+        read += 2;
+
+        // Would run into text we haven't read yet, so the lengths must be wrong
+        if (write + size > read) {
+            return false;
+        }
+        memcpy(buffer + write, entry, size);
+        write += size;
+    }
+
+    buffer[write] = '\0';
+    return write == length;
+}
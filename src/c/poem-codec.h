@@ -0,0 +1,20 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Optional compact encoding for poems on the wire
+ *
+ * Satellite poems reuse a small vocabulary, so the phone replaces common words
+ * and phrases with two byte tokens: POEM_CODEC_TOKEN followed by an index into
+ * a dictionary shared with src/pkjs/codec.js. Everything else is sent as is.
+ *
+ * Every dictionary entry is at least two bytes, so decoded text is never
+ * shorter than the encoded text. That lets us decode in place: the encoded
+ * bytes sit at the end of the buffer and the decoded text is written from
+ * the start without ever catching up with what's left to read.
+ */
+
+#define POEM_CODEC_TOKEN 0x01
+
+bool poem_codec_decode(char *buffer, uint16_t length, uint16_t wire_offset);
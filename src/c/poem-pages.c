@@ -0,0 +1,117 @@
+#include "poem-pages.h"
+#include "logging.h"
+
+// Scratch space for measuring and drawing a single line
+static char s_line_buffer[POEM_LINE_MAX];
+
+/*
+ * Copy text[start, end) into the line buffer, trimmed to fit
+ */
+static const char *line_text(const char *text, uint16_t start, uint16_t end) {
+    uint16_t size = end - start;
+    if (size >= sizeof(s_line_buffer)) {
+        size = sizeof(s_line_buffer) - 1;
+    }
+    memcpy(s_line_buffer, text + start, size);
+    s_line_buffer[size] = '\0';
+    return s_line_buffer;
+}
+
+/*
+ * Does text[start, end) fit on one line of the given width?
+ */
+static bool line_fits(const char *text, uint16_t start, uint16_t end, GFont font, int16_t width) {
+    GSize size = graphics_text_layout_get_content_size(
+            line_text(text, start, end),
+            font,
+            GRect(0, 0, 4 * width, 100),
+            GTextOverflowModeTrailingEllipsis,
+            GTextAlignmentLeft);
+    return size.w <= width;
+}
+
+static bool is_break(char c) {
+    return c == ' ' || c == '\n';
+}
+
+/*
+ * Word wrap the text into lines no wider than width
+ * Hard line breaks in the poem are kept; a word too long for a line gets a line to itself
+ */
+void poem_pages_layout(PoemPages *pages, const char *text, GFont font, int16_t width) {
+    uint16_t length = strlen(text);
+    uint16_t pos = 0;
+
+    pages->text = text;
+    pages->length = length;
+    pages->line_count = 0;
+
+    while (pos < length && pages->line_count < POEM_MAX_LINES) {
+        uint16_t end = pos;
+        uint16_t scan = pos;
+
+        pages->line_starts[pages->line_count++] = pos;
+
+        // Add words until the next one no longer fits
+        while (true) {
+            uint16_t word_end = scan;
+            while (word_end < length && !is_break(text[word_end])) {
+                word_end++;
+            }
+
+            if (end != pos && !line_fits(text, pos, word_end, font, width)) {
+                break;
+            }
+
+            end = word_end;
+            if (end >= length || text[end] == '\n') {
+                break;
+            }
+            scan = end + 1;
+        }
+
+        // Skip the break we wrapped on: a single newline, or any run of spaces
+        pos = end;
+        if (pos < length && text[pos] == '\n') {
+            pos++;
+        } else {
+            while (pos < length && text[pos] == ' ') {
+                pos++;
+            }
+            if (pos < length && text[pos] == '\n') {
+                pos++;
+            }
+        }
+    }
+
+    if (pos < length) {
+        LOG_WARNING("Poem longer than %d lines, truncating", POEM_MAX_LINES);
+    }
+}
+
+uint16_t poem_pages_page_count(const PoemPages *pages, uint8_t lines_per_page) {
+    return (pages->line_count + lines_per_page - 1) / lines_per_page;
+}
+
+/*
+ * Draw num_lines lines starting at first_line, one line_height apart
+ */
+void poem_pages_draw(const PoemPages *pages, GContext *ctx, GFont font, GRect bounds,
+        uint16_t first_line, uint8_t num_lines, int16_t line_height, GTextAlignment alignment) {
+    for (uint8_t i = 0; i < num_lines; i++) {
+        uint16_t line = first_line + i;
+        if (line >= pages->line_count) {
+            break;
+        }
+
+        uint16_t start = pages->line_starts[line];
+        uint16_t end = (line + 1 < pages->line_count) ? pages->line_starts[line + 1] : pages->length;
+        while (end > start && is_break(pages->text[end - 1])) {
+            end--;
+        }
+
+        graphics_draw_text(ctx, line_text(pages->text, start, end), font,
+                GRect(bounds.origin.x, bounds.origin.y + i * line_height, bounds.size.w, bounds.size.h - i * line_height),
+                GTextOverflowModeTrailingEllipsis, alignment, NULL);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Pagination for poems
+ *
+ * The poem is word wrapped once, when it arrives, into a table of line start
+ * offsets. Page n is simply lines n * lines_per_page onwards, so drawing a page
+ * only touches the handful of lines that are actually on screen.
+ */
+
+#define POEM_MAX_LINES 192
+#define POEM_LINE_MAX 128 // longest line in bytes we'll draw
+
+typedef struct {
+    const char *text;
+    uint16_t length;
+    uint16_t line_count;
+    uint16_t line_starts[POEM_MAX_LINES];
+} PoemPages;
+
+void poem_pages_layout(PoemPages *pages, const char *text, GFont font, int16_t width);
+uint16_t poem_pages_page_count(const PoemPages *pages, uint8_t lines_per_page);
+void poem_pages_draw(const PoemPages *pages, GContext *ctx, GFont font, GRect bounds,
+        uint16_t first_line, uint8_t num_lines, int16_t line_height, GTextAlignment alignment);
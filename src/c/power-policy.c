@@ -0,0 +1,71 @@
+#include "power-policy.h"
+#include "logging.h"
+
+// How much longer pages stay up, and poem requests are apart, at each level
+static const uint8_t s_dwell_scale[] = {1, 2, 4};
+static const uint8_t s_period_scale[] = {1, 2, 3};
+
+static PowerLevel s_level = POWER_NORMAL;
+static PowerLevelHandler s_handler = NULL;
+
+static PowerLevel level_for(BatteryChargeState charge) {
+    if (charge.is_charging || charge.is_plugged) {
+        return POWER_NORMAL;
+    }
+    if (charge.charge_percent <= SAT_BATTERY_CRITICAL) {
+        return POWER_CRITICAL;
+    }
+    if (charge.charge_percent <= SAT_BATTERY_LOW) {
+        return POWER_LOW;
+    }
+    return POWER_NORMAL;
+}
+
+static void battery_handler(BatteryChargeState charge) {
+    PowerLevel level = level_for(charge);
+    if (level == s_level) {
+        return;
+    }
+
+    LOG_INFO("Battery at %d%%, power level %d", (int)charge.charge_percent, (int)level);
+    s_level = level;
+    if (s_handler) {
+        s_handler(level);
+    }
+}
+
+/*
+ * Start following the battery; handler is called whenever the level changes
+ */
+void power_policy_init(PowerLevelHandler handler) {
+    s_handler = handler;
+    s_level = level_for(battery_state_service_peek());
+    battery_state_service_subscribe(battery_handler);
+}
+
+void power_policy_deinit(void) {
+    battery_state_service_unsubscribe();
+    s_handler = NULL;
+}
+
+PowerLevel power_policy_level(void) {
+    return s_level;
+}
+
+/*
+ * Time to stay on a screen that would take ms at full power
+ */
+uint32_t power_policy_dwell(uint32_t ms) {
+    return ms * s_dwell_scale[s_level];
+}
+
+/*
+ * Minutes between poem requests that would be minutes apart at full power
+ */
+uint8_t power_policy_poem_period(uint8_t minutes) {
+    return minutes * s_period_scale[s_level];
+}
+
+bool power_policy_show_title(void) {
+    return s_level != POWER_CRITICAL;
+}
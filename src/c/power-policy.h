@@ -0,0 +1,36 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * How hard to work, depending on the battery
+ *
+ * Below SAT_BATTERY_LOW percent we keep each page up for longer and ask the
+ * phone for poems less often. Below SAT_BATTERY_CRITICAL we stretch both
+ * further and skip the title screen, going straight from one reading of the
+ * poem to the next. On the charger we're always at full power.
+ * Override the thresholds at build time, e.g. SAT_BATTERY_LOW=40 pebble build
+ */
+
+#ifndef SAT_BATTERY_LOW
+#define SAT_BATTERY_LOW 30
+#endif
+
+#ifndef SAT_BATTERY_CRITICAL
+#define SAT_BATTERY_CRITICAL 10
+#endif
+
+typedef enum {
+    POWER_NORMAL = 0,
+    POWER_LOW,
+    POWER_CRITICAL
+} PowerLevel;
+
+typedef void (*PowerLevelHandler)(PowerLevel level);
+
+void power_policy_init(PowerLevelHandler handler);
+void power_policy_deinit(void);
+PowerLevel power_policy_level(void);
+uint32_t power_policy_dwell(uint32_t ms);
+uint8_t power_policy_poem_period(uint8_t minutes);
+bool power_policy_show_title(void);
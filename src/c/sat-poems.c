@@ -4,44 +4,39 @@
 // Working with more than 3-byte unicode glyphs:
 // https://forums.pebble.com/t/how-can-i-filter-3-byte-unicode-characters-glyphs-in-ttf/26024
 //
+// Font metrics come from src/c/generated/font-metrics.h, which the build generates from the fonts in package.json
+// Screen positions and paging are per platform constants in layout.h
+//
 // TODO
-// * Figure out how to properly calculate the size of the scroll window for a given font size, have to take into account descenders, need to ensure that we scroll by an integral amount of maximum height + descenders
 // * I like Fell English at 24, but need to recalculate the sizes accordingly
 // * Try different fonts, sans-serif fonts too, also for the time line below 
 // * Try text for time too
-// * Generative poem, for Lisa only, that takes pyephem data for Sun, Moon, planets, asteroids (!), and creates poem based off of that
 
 /*
- * State machine for these poems:
- * 1. Start screen (blank for a period or so)
- * 2. Title screen (a couple of periods)
- * 3. Blank screen (for a period or two)
- * 4. Poem, scroll from top to bottom (we might want to split out to another state machine here, for the scrolling, and/or for the scrolling of individual screens if we decide to do things that way)
- * 5. Blank screen (a couple of periods)
+ * Presentation timeline for these poems (s_default_timeline, see timeline.h):
+ * 1. Start screen (blank for a second)
+ * 2. Title screen (a couple of seconds)
+ * 3. Blank screen (a second)
+ * 4. Poem, a page at a time from top to bottom
+ * 5. Blank screen (a second)
  * 6. Restart
+ * The phone can replace this with a timeline of its own.
  */
 
 #include <pebble.h>
-#define TIMER_PERIOD 500
-
-// State machine variables for satellite poem
-typedef enum
-{
-    STATE_START = 0,
-    STATE_TITLE,
-    STATE_BLANK_1,
-    STATE_POEM,
-    STATE_BLANK_2
-} satellite_state_t;
-
-
-
-
-satellite_state_t satellite_state = STATE_START;
-static uint8_t current_period = 0;
-
-// Margin for text, in pixels
-uint8_t margin = 4;
+#include "diagnostics.h"
+#include "font-cache.h"
+#include "layout.h"
+#include "logging.h"
+#include "poem-cache.h"
+#include "poem-chunks.h"
+#include "poem-pages.h"
+#include "power-policy.h"
+#include "sat-predict.h"
+#include "timeline.h"
+#include "trace.h"
+#include "transport.h"
+#include "visibility.h"
 
 // Layers and fonts
 static Window *s_main_window;
@@ -50,83 +45,91 @@ static Layer *window_layer;
 static TextLayer *s_time_layer;
 static GFont s_time_font;
 
-static TextLayer *s_poem_layer;
+static Layer *s_poem_layer = NULL;
 static GFont s_poem_font;
 
 static TextLayer *s_title_layer = NULL;
 static GFont s_title_font;
-static const char *default_title = "A SATELLITE POEM";
-
-static ScrollLayer *s_scroll_layer;
-
-// Screen bounds
-static GRect bounds;
 
-// Calculations for scrolling based on font size
-// Probably need to change when we change fonts for text on scroll layer
-// Size 24: 24 pixels high plus around 8 for descenders, then 24 pixels for each line, and -1 to make pixel "perfect"
-static int fontSize = 24; // in pixels (?)
-static int descenderSize = 6; // in pixels (?)
-static int numLines = 5; // total number of lines we'd like to display on screen at this font size
-int scrollSize, pageScroll;
+// Held for as long as the window is loaded, so the title and poem layers
+// coming and going don't reload Charis from flash every cycle
+static GFont s_charis_font;
 
-// Keeping track of state time
-AppTimer *stateTimer; // Timer for checking our state
-int currentStateTime = 0; // Counter for keeping track of time
+// Line table for the current poem and the page we're showing
+static PoemPages s_poem_pages;
+static uint16_t s_current_page = 0;
 
 // Duration of periods
-static uint8_t updatePeriod = 4; // Scroll every updatePeriod seconds
-//static uint8_t updatePeriod = 1; // Scroll every updatePeriod seconds
 static uint8_t poemPeriod  = 10; // Update poem every poemPeriod minutes
 //static uint8_t poemPeriod  = 1; // Update poem every poemPeriod minutes
 
-// TODO
-// These periods are tied to the updatePeriod variable...I think we need to change it to be based on milliseconds or some other time-based value
-uint8_t state_periods[] = {
-    1,
-    1,
-    1,
-    0, // we don't move forward in STATE_POEM based on periods
-    1
-};
+// Page turns wipe the new page in over the old one from the top, a few lines
+// per frame, in at most PAGE_TRANSITION_FRAMES frames
+// Build with SAT_PAGE_TRANSITION=0 to turn pages instantly instead
+#ifndef SAT_PAGE_TRANSITION
+#define SAT_PAGE_TRANSITION 1
+#endif
+#define PAGE_TRANSITION_FRAMES 5
+#define PAGE_TRANSITION_FRAME_MS 50
+#define PAGE_TRANSITION_LINES_PER_FRAME ((LAYOUT_POEM_LINES + PAGE_TRANSITION_FRAMES - 1) / PAGE_TRANSITION_FRAMES)
 
-// Amount of time to stay in each state, based on the granularity of the timer
-int state_times[] = {
-    1 * TIMER_PERIOD,
-    4 * TIMER_PERIOD,
-    1 * TIMER_PERIOD,
-    8 * TIMER_PERIOD, 
-    1 * TIMER_PERIOD
-};
+// Lines of the current page on screen; the rest still show the previous page
+static uint8_t s_transition_lines = LAYOUT_POEM_LINES;
+static AppTimer *s_transition_timer = NULL;
+static uint8_t s_transition_frames = 0;
+static uint32_t s_transition_draw_ms = 0;
+
+
+
+// Text for incoming information, allocated to fit whatever the phone sends
+// and handed directly to the text layers
+static char *s_title_text = NULL;
+static char *s_poem_text = NULL;
+static uint32_t s_poem_hash = 0; // transport_hash of the two, so the phone can tell what we have
+
+// Poem being assembled from chunks, and the title that goes with it
+static PoemChunks s_poem_chunks;
+static char *s_pending_title = NULL;
+static uint32_t s_pending_location = 0;
+static time_t s_pending_valid_from = 0;
+static time_t s_pending_valid_until = 0;
+static uint32_t s_pending_hash = 0; // POEM_HASH of the poem being assembled, 0 if it didn't have one
 
+// Cache slot of the poem we're showing, or -1 if it didn't come from the cache
+static int s_current_slot = -1;
 
+// End of the window of a poem from the phone too long to cache, if that's what
+// we're showing; until then nothing older in the cache takes its place
+static time_t s_uncached_until = 0;
 
-// Buffers for incoming information
-static char title_buffer[256] = {0};
-static char title_layer_buffer[256] = {0};
+// Don't write our own poem before this time, because we just did or the phone
+// sent one we couldn't cache
+static time_t s_next_prediction = 0;
 
-static char poem_buffer[2048];
-static char poem_layer_buffer[2048];
+// Shown until the first poem arrives
+static const char *waiting_text = "Waiting to know the objects above...";
+
+// Set when the poem changes and its line table needs rebuilding
+static bool s_poem_pages_stale = true;
 
 /*
  * Create title layer with optional default title
+ * Only exists while we're in STATE_TITLE; its font stays loaded with the window
  */
 static void generate_title_layer(char *title) {
-    uint8_t text_height = 20 + 8 + 20 + 20;
-    s_title_layer = text_layer_create(
-            GRect(margin, PBL_IF_ROUND_ELSE(84 - (text_height/2), 84 - (text_height/2)), bounds.size.w - (2 * margin), text_height));
+    s_title_layer = text_layer_create(LAYOUT_TITLE_RECT);
 
-    //s_title_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_ADOBE_JENSON_24));
-    s_title_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_CHARIS_SIL_24));
+    //s_title_font = font_cache_get(RESOURCE_ID_FONT_ADOBE_JENSON_24);
+    s_title_font = font_cache_get(RESOURCE_ID_FONT_CHARIS_SIL_24);
 
     // Improve the layout to be more like a watchface
     text_layer_set_background_color(s_title_layer, GColorClear);
     text_layer_set_text_color(s_title_layer, GColorWhite);
 
-    if (title_layer_buffer[0] == 0) {
+    if (s_title_text == NULL) {
         text_layer_set_text(s_title_layer, title);
     } else {
-        text_layer_set_text(s_title_layer, title_layer_buffer);
+        text_layer_set_text(s_title_layer, s_title_text);
     }
     text_layer_set_font(s_title_layer, s_title_font);
     text_layer_set_text_alignment(s_title_layer, GTextAlignmentCenter);
@@ -135,25 +138,64 @@ static void generate_title_layer(char *title) {
     layer_add_child(window_layer, text_layer_get_layer(s_title_layer));
 }
 
+static void destroy_title_layer(void) {
+    if (s_title_layer) {
+        layer_remove_from_parent(text_layer_get_layer(s_title_layer));
+        text_layer_destroy(s_title_layer);
+        font_cache_release(s_title_font);
+        s_title_layer = NULL;
+    }
+}
+
+static void poem_layer_update_proc(Layer *layer, GContext *ctx);
+
 /*
- * Methods for showing and hiding text and scroll layers
+ * Rebuild the line table if the poem has changed since we last wrapped it
+ * Needs the poem font, so only happens while the poem layer exists
  */
-static void show_title_layer(void) {
-    layer_set_hidden((Layer *)s_title_layer, false);
-}
+static void layout_poem(void) {
+    if (!s_poem_pages_stale) {
+        return;
+    }
 
+    uint32_t start = diagnostics_clock();
+    poem_pages_layout(&s_poem_pages, s_poem_text ? s_poem_text : waiting_text, s_poem_font, LAYOUT_TEXT_WIDTH);
+    diagnostics_record(DIAG_POEM_LAYOUT, start);
 
-static void hide_scroll_layer(void) {
-    layer_set_hidden((Layer *)s_scroll_layer, true);
+    s_poem_pages_stale = false;
+    LOG_INFO("Poem has %d lines", (int)s_poem_pages.line_count);
+    trace_event(TRACE_POEM_SET, s_poem_pages.line_count);
 }
 
-static void show_scroll_layer(void) {
-    layer_set_hidden((Layer *)s_scroll_layer, false);
+/*
+ * Create poem layer, one page tall; pages are drawn by poem_layer_update_proc
+ * Only exists while we're in STATE_POEM; its font stays loaded with the window
+ */
+static void generate_poem_layer(void) {
+    // Comes from the font cache, so this shares the title's Charis
+    //s_poem_font = font_cache_get(RESOURCE_ID_FONT_IMFELL_ENGLISH_28);
+    //s_poem_font = font_cache_get(RESOURCE_ID_FONT_ADOBE_JENSON_24);
+    s_poem_font = font_cache_get(RESOURCE_ID_FONT_CHARIS_SIL_24);
+    //s_poem_font = font_cache_get(RESOURCE_ID_FONT_PERFECT_DOS_20);
+
+    // TODO: Work on margins, readable font size
+    s_poem_layer = layer_create(LAYOUT_POEM_RECT);
+    layer_set_update_proc(s_poem_layer, poem_layer_update_proc);
+    layout_poem();
+
+    layer_add_child(window_layer, s_poem_layer);
 }
 
+static void cancel_page_transition(void);
 
-static void hide_title_layer(void) {
-    layer_set_hidden((Layer *)s_title_layer, true);
+static void destroy_poem_layer(void) {
+    cancel_page_transition();
+    if (s_poem_layer) {
+        layer_remove_from_parent(s_poem_layer);
+        layer_destroy(s_poem_layer);
+        font_cache_release(s_poem_font);
+        s_poem_layer = NULL;
+    }
 }
 
 /*
@@ -174,279 +216,326 @@ static void update_time() {
 
 
 /*
- * Scroll text area forward each updatePeriod
+ * Draw just the lines of the current page
  */
-static void scroll_poem(void) {
-    int absOffset;
+static void poem_layer_update_proc(Layer *layer, GContext *ctx) {
+    uint32_t start = diagnostics_clock();
+    GRect layer_bounds = layer_get_bounds(layer);
+    uint16_t first_line = s_current_page * LAYOUT_POEM_LINES;
+
+    graphics_context_set_text_color(ctx, GColorWhite);
+    poem_pages_draw(&s_poem_pages, ctx, s_poem_font, layer_bounds,
+            first_line, s_transition_lines, LAYOUT_POEM_LINE_HEIGHT,
+            LAYOUT_POEM_ALIGNMENT);
+
+    // Part way through a page turn, the bottom lines are still the previous page
+    if (s_transition_lines < LAYOUT_POEM_LINES) {
+        int16_t top = s_transition_lines * LAYOUT_POEM_LINE_HEIGHT;
+        poem_pages_draw(&s_poem_pages, ctx, s_poem_font,
+                GRect(layer_bounds.origin.x, layer_bounds.origin.y + top, layer_bounds.size.w, layer_bounds.size.h - top),
+                first_line - LAYOUT_POEM_LINES + s_transition_lines, LAYOUT_POEM_LINES - s_transition_lines,
+                LAYOUT_POEM_LINE_HEIGHT, LAYOUT_POEM_ALIGNMENT);
+    }
 
-    GSize content_size = scroll_layer_get_content_size(s_scroll_layer);
-    GPoint content_offset = scroll_layer_get_content_offset(s_scroll_layer);
+    diagnostics_record(DIAG_PAGE_DRAW, start);
+
+    // Account for the frames of a transition, and report once its last frame is up
+    if (s_transition_frames > 0 || s_transition_timer) {
+        s_transition_frames++;
+        s_transition_draw_ms += diagnostics_clock() - start;
+        if (!s_transition_timer) {
+            LOG_DEBUG("Page transition took %d frames, %d ms drawing", (int)s_transition_frames, (int)s_transition_draw_ms);
+            trace_event(TRACE_PAGE_TRANSITION, s_transition_frames);
+            diagnostics_record_ms(DIAG_PAGE_TRANSITION, s_transition_draw_ms);
+            s_transition_frames = 0;
+            s_transition_draw_ms = 0;
+        }
+    }
+}
 
-    APP_LOG(APP_LOG_LEVEL_INFO, "y content offset: %d", (int)content_offset.y);
-    APP_LOG(APP_LOG_LEVEL_INFO, "y content size: %d", (int)content_size.h);
-    APP_LOG(APP_LOG_LEVEL_INFO, "Scrolling by a page");
+/*
+ * Uncover a few more lines of the new page each frame until it's all there
+ */
+static void page_transition_callback(void *data) {
+    s_transition_timer = NULL;
+    s_transition_lines += PAGE_TRANSITION_LINES_PER_FRAME;
+    if (s_transition_lines < LAYOUT_POEM_LINES) {
+        s_transition_timer = app_timer_register(PAGE_TRANSITION_FRAME_MS, page_transition_callback, NULL);
+    } else {
+        s_transition_lines = LAYOUT_POEM_LINES;
+    }
+    layer_mark_dirty(s_poem_layer);
+}
 
+/*
+ * Show s_current_page, which has just moved on from the page before it
+ */
+static void start_page_transition(void) {
+#if SAT_PAGE_TRANSITION
+    cancel_page_transition();
+    s_transition_lines = 0;
+    page_transition_callback(NULL);
+#else
+    layer_mark_dirty(s_poem_layer);
+#endif
+}
 
-    absOffset = (int)content_offset.y;
-    if (absOffset < 0) {
-        absOffset = absOffset * -1;
+static void cancel_page_transition(void) {
+    if (s_transition_timer) {
+        app_timer_cancel(s_transition_timer);
+        s_transition_timer = NULL;
     }
+    s_transition_lines = LAYOUT_POEM_LINES;
+    s_transition_frames = 0;
+    s_transition_draw_ms = 0;
+}
 
-    // This is probably horribly inefficient, need to see if there is something better
-    // If we're at the top, scroll by a page
-    if ((int)content_offset.y == 0) {
-        scroll_layer_set_content_offset(s_scroll_layer, GPoint(0, content_offset.y - pageScroll), true);
-    } else {
-        // We seem to be scrolled somehow
-        // Check and see if we should continue scrolling
-        // We continue scrolling if our absOffset + our scrolling page 
-        // is >= our content size
-        if ((absOffset + pageScroll + descenderSize) >= (int)content_size.h) {
-            // Return to start
-            //APP_LOG(APP_LOG_LEVEL_INFO, "HERE");
-            scroll_layer_set_content_offset(s_scroll_layer, GPoint(0, 0), true);
-            hide_scroll_layer();
-            satellite_state = STATE_BLANK_2;
+/*
+ * Turn to the next page of the poem
+ * Returns false once we've run off the end of the poem, ready to start again from the top
+ */
+static bool scroll_poem(void) {
+    uint16_t page_count = poem_pages_page_count(&s_poem_pages, LAYOUT_POEM_LINES);
 
-        } else {
-            scroll_layer_set_content_offset(s_scroll_layer, GPoint(0, content_offset.y - pageScroll), true);
-        }
+    LOG_DEBUG("Page %d of %d", (int)s_current_page, (int)page_count);
 
+    if (s_current_page + 1 < page_count) {
+        s_current_page++;
+        trace_event(TRACE_PAGE, s_current_page);
+        start_page_transition();
+        return true;
     }
 
+    // Return to start
+    s_current_page = 0;
+    return false;
 }
 
-/**
- * Timer that gets called every TIMER_PERIOD milliseconds to deal with state changes
+/*
+ * Timeline actions, numbered so the phone can refer to them
+ * Don't renumber: timelines from the phone are kept in persistent storage
  */
-static void stateTimerCallback(void *data) {
-
-    switch (satellite_state) {
-        case STATE_START:
-            if (currentStateTime < state_times[STATE_START]) {
+typedef enum {
+    ACTION_NONE = TIMELINE_NO_ACTION,
+    ACTION_SHOW_TITLE,
+    ACTION_HIDE_TITLE,
+    ACTION_SHOW_POEM,
+    ACTION_HIDE_POEM,
+    ACTION_NEXT_PAGE, // repeat action: another page until the end of the poem
+    ACTION_COUNT
+} TimelineActionId;
+
+static bool show_title(void) {
+    if (!s_title_layer) {
+        generate_title_layer("SATELLITE POEMS");
+    }
+    return false;
+}
 
-                currentStateTime += TIMER_PERIOD;
-            } else {
-                currentStateTime = 0;
-                show_title_layer();
-                satellite_state = STATE_TITLE;
-            }
-            break;
-        case STATE_TITLE:
-            if (currentStateTime < state_times[STATE_TITLE]) {
-                currentStateTime += TIMER_PERIOD;
-            } else {
-                currentStateTime = 0;
-                hide_title_layer();
-                satellite_state = STATE_BLANK_1;
-                updatePeriod = 4;
-            }
-            break;
-        case STATE_BLANK_1:
-            if (currentStateTime < state_times[STATE_BLANK_1]) {
-                currentStateTime += TIMER_PERIOD;
-            } else {
-                currentStateTime = 0;
-                show_scroll_layer();
-                satellite_state = STATE_POEM;
-                updatePeriod = 6;
-            }
+static bool hide_title(void) {
+    destroy_title_layer();
+    return false;
+}
 
-            break;
-        case STATE_POEM:
+static bool show_poem(void) {
+    if (!s_poem_layer) {
+        generate_poem_layer();
+    }
+    return false;
+}
 
-            // Before scrolling, we could probably change our updatePeriod
-            // to something different than the other periods
-            if (currentStateTime < state_times[STATE_POEM]) {
-                currentStateTime += TIMER_PERIOD;
-            } else {
-                scroll_poem();
-                currentStateTime = 0;
-            }
+static bool hide_poem(void) {
+    s_current_page = 0;
+    destroy_poem_layer();
+    return false;
+}
 
+static bool next_page(void) {
+    return s_poem_layer && scroll_poem();
+}
 
-            break;
-        case STATE_BLANK_2:
-            if (currentStateTime < state_times[STATE_BLANK_2]) {
-                currentStateTime += TIMER_PERIOD;
-            } else {
-                currentStateTime = 0;
-                satellite_state = STATE_START;
-                updatePeriod = 4;
-            }
+static const TimelineAction s_timeline_actions[ACTION_COUNT] = {
+    [ACTION_SHOW_TITLE] = show_title,
+    [ACTION_HIDE_TITLE] = hide_title,
+    [ACTION_SHOW_POEM] = show_poem,
+    [ACTION_HIDE_POEM] = hide_poem,
+    [ACTION_NEXT_PAGE] = next_page
+};
 
-            break;
-        
-    }
+// Built in timeline; the poem's duration is per page
+// Short on battery, the title and the blank after it are passed over
+static const TimelineStep s_default_timeline[] = {
+    // duration, enter, exit, repeat, next, flags
+    { 1000, ACTION_NONE, ACTION_NONE, ACTION_NONE, 1, 0, 0 },
+    { 2500, ACTION_SHOW_TITLE, ACTION_HIDE_TITLE, ACTION_NONE, 2, TIMELINE_OPTIONAL, 0 },
+    { 1000, ACTION_NONE, ACTION_NONE, ACTION_NONE, 3, TIMELINE_OPTIONAL, 0 },
+    { 4500, ACTION_SHOW_POEM, ACTION_HIDE_POEM, ACTION_NEXT_PAGE, 4, 0, 0 },
+    { 1000, ACTION_NONE, ACTION_NONE, ACTION_NONE, 0, 0, 0 }
+};
 
+static bool skip_title(void) {
+    return !power_policy_show_title();
+}
 
+static const TimelineHooks s_timeline_hooks = {
+    .actions = s_timeline_actions,
+    .num_actions = ACTION_COUNT,
+    .dwell = power_policy_dwell,
+    .skip_optional = skip_title
+};
 
-    // Register timer for next period
-    stateTimer = app_timer_register(TIMER_PERIOD, (AppTimerCallback) stateTimerCallback, NULL);
-}
 
+static void set_poem(char *poem_text, char *title_text);
 
 /*
- * Main handler for moving through our state machine, updating time, etc.
+ * Show the cached poem whose window covers now, if it isn't already showing
  */
-static void tick_handler_seconds(struct tm *tick_time, TimeUnits units_changed) {
-
-    // Update every updatePeriod seconds
-    // We will probably be able to delete the following given our refactoring
-    /*
-    if (tick_time->tm_sec % updatePeriod == 0) {
-        
-        APP_LOG(APP_LOG_LEVEL_INFO, "Current state: %d", satellite_state);
-        switch (satellite_state) {
-            case STATE_START:
-                if (current_period < state_periods[STATE_START]) {
-                    current_period += 1;
-                } else {
-                    current_period = 0;
-                    show_title_layer();
-                    satellite_state = STATE_TITLE;
-                    updatePeriod = 6;
-                }
-                break;
-            case STATE_TITLE:
-                if (current_period < state_periods[STATE_TITLE]) {
-                    current_period += 1;
-                } else {
-                    current_period = 0;
-                    hide_title_layer();
-                    satellite_state = STATE_BLANK_1;
-                    updatePeriod = 4;
-                }
-                break;
-            case STATE_BLANK_1:
-                if (current_period < state_periods[STATE_BLANK_1]) {
-                    current_period += 1;
-                } else {
-                    current_period = 0;
-                    show_scroll_layer();
-                    satellite_state = STATE_POEM;
-                    updatePeriod = 6;
-                }
+static void predicted_poem_callback(char *title, char *poem) {
+    // The phone's poem for now may have come in while we were searching
+    time_t now = time(NULL);
+    if (poem_cache_find(now) >= 0 || now < s_uncached_until) {
+        free(poem);
+        free(title);
+        return;
+    }
+    set_poem(poem, title);
+    s_current_slot = -1;
+    s_uncached_until = 0;
+}
 
-                break;
-            case STATE_POEM:
-
-                // Before scrolling, we could probably change our updatePeriod
-                // to something different than the other periods
-                scroll_poem();
-
-                break;
-            case STATE_BLANK_2:
-                if (current_period < state_periods[STATE_BLANK_2]) {
-                    current_period += 1;
-                } else {
-                    current_period = 0;
-                    satellite_state = STATE_START;
-                    updatePeriod = 4;
-                }
+static void show_current_poem(void) {
+    time_t now = time(NULL);
+    if (s_current_slot < 0 && now < s_uncached_until) {
+        return;
+    }
+    int slot = poem_cache_find(now);
 
-                break;
-            
+    // Nothing from the phone covers now, so write our own if we know the sky
+    if (slot < 0) {
+        if (now >= s_next_prediction && sat_predict_generate(now, predicted_poem_callback)) {
+            s_next_prediction = now + power_policy_poem_period(poemPeriod) * 60;
         }
+        return;
+    }
 
-    } 
-    */
-
-    // Update time every minute    
-    if (tick_time->tm_sec % 60 == 0) {
-        update_time();
-        APP_LOG(APP_LOG_LEVEL_INFO, "updating time");
+    if (slot == s_current_slot) {
+        return;
     }
 
-    // TODO
-    // Switch from repretoire of poems, maybe a set of three (?) every few minutes
-    // Update satellites overhead every 5-15 minutes
-    // In poem, talk about the time the satellite was overhead
+    char *title, *poem;
+    if (poem_cache_load(slot, &title, &poem)) {
+        set_poem(poem, title);
+        s_current_slot = slot;
+    }
+}
 
-    // Update poem every poemPeriod minutes
-    // Check the minute
-    if (tick_time->tm_min % poemPeriod == 0) {
-        // and then ensure that we only do this once during the minute
-        if (tick_time->tm_sec % 60 == 0) {
-            // Begin dictionary
-            DictionaryIterator *iter;
-            app_message_outbox_begin(&iter);
-    
-            // Add a key-value pair
-            dict_write_uint8(iter, 0, 0);
-    
-            app_message_outbox_send();
-
-            // Reset scroll layer
-            scroll_layer_set_content_offset(s_scroll_layer, GPoint(0, 0), true);
-            APP_LOG(APP_LOG_LEVEL_INFO, "Updating poem");
-        }
+/*
+ * Are we about to run out of scheduled poems, so should ask the phone for more?
+ */
+static bool poem_is_stale(void) {
+    time_t valid_until = poem_cache_valid_until();
+    if (s_uncached_until > valid_until) {
+        valid_until = s_uncached_until;
     }
+    return valid_until - time(NULL) < power_policy_poem_period(poemPeriod) * 60;
+}
 
+/*
+ * Ask the phone for a new poem
+ */
+static void request_poem(void) {
+    // Let the phone know what we have of a poem it didn't finish sending
+    bool partial = s_pending_hash != 0 && s_poem_chunks.text;
+    transport_request_poem(s_poem_hash, partial ? s_pending_hash : 0, partial ? s_poem_chunks.received : 0);
+    trace_event(TRACE_POEM_REQUEST, 0);
+    LOG_INFO("Updating poem");
 }
 
 /*
- * Set up window, layers, and fonts
+ * Main handler for updating time and refreshing the poem
+ * Subscribed at MINUTE_UNIT, so this only runs once a minute; everything
+ * finer grained is driven by the timeline
  */
-static void main_window_load(Window *window) {
+static void tick_handler_minutes(struct tm *tick_time, TimeUnits units_changed) {
+    trace_event(TRACE_TICK, tick_time->tm_min);
+    visibility_tick();
 
-    //static int scrollSize = 32 + 24 + 24 + 24 + 24 - 1;
-    scrollSize = (fontSize + descenderSize) + (numLines - 1) * fontSize;
-    // The amount we scroll is based on the point size, and does not include the descenders
-    //static int pageScroll = 5 * 24;
-    pageScroll = numLines * fontSize;
+    // Update time every minute
+    update_time();
+    LOG_DEBUG("updating time");
 
-   
-    // Get information about the window
-    window_layer = window_get_root_layer(window);
-    bounds = layer_get_frame(window_layer);
-    GRect max_text_bounds = GRect(0, 0, bounds.size.w - (margin * 2), 2000);
+    // TODO
+    // In poem, talk about the time the satellite was overhead
 
-    // Create time GFont
-    s_time_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_ANDIKA_20));
-    //s_time_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_DELICIOUS_20));
+    // Switch to whichever poem in our batch is valid now; while hidden that
+    // waits until we're seen again
+    if (visibility_is_visible()) {
+        show_current_poem();
+    }
 
-    // Create poem font
-    //s_poem_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_IMFELL_ENGLISH_28));
-    //s_poem_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_ADOBE_JENSON_24));
-    s_poem_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_CHARIS_SIL_24));
-    //s_poem_font = fonts_load_custom_font(resource_get_handle(RESOURCE_ID_FONT_PERFECT_DOS_20));
+    // Ask for the next batch every poemPeriod minutes, but only once this one is running out
+    if (visibility_is_visible() && tick_time->tm_min % power_policy_poem_period(poemPeriod) == 0 && poem_is_stale()) {
+        request_poem();
+    }
 
-    // Create scroll layer
-    s_scroll_layer = scroll_layer_create(GRect(margin, PBL_IF_ROUND_ELSE(margin + 5, margin), bounds.size.w - (margin * 2), scrollSize));
-    //s_scroll_layer = scroll_layer_create(bounds);
+    // Report heap and timing once an hour
+    diagnostics_sample_heap();
+    if (tick_time->tm_min == DIAGNOSTICS_MINUTE) {
+        diagnostics_send();
+    }
 
-    // This binds the scroll layer to the window so that up/down map to scrolling
-    scroll_layer_set_click_config_onto_window(s_scroll_layer, window);
-    scroll_layer_set_shadow_hidden(s_scroll_layer, true);
+}
 
-    generate_title_layer("SATELLITE POEMS");
-    hide_title_layer();
+/*
+ * Nobody's looking, so stop turning pages, switching and asking for poems until they are again
+ * On the way back we carry on from the step and page we were on, with a fresh dwell
+ */
+static void visibility_handler(bool visible) {
+    trace_event(TRACE_VISIBILITY, visible);
 
-    // Create poem Layer
-    // TODO: Work on margins, readable font size
-    
-    //s_poem_layer = text_layer_create(GRect(margin, PBL_IF_ROUND_ELSE(margin + 5, margin), bounds.size.w - (margin * 2), 140));
-    s_poem_layer = text_layer_create(max_text_bounds);
-
-    // Style poem layer text
-    text_layer_set_background_color(s_poem_layer, GColorClear);
-    text_layer_set_text_color(s_poem_layer, GColorWhite);
-#if defined(PBL_ROUND)
-    text_layer_set_text_alignment(s_poem_layer, GTextAlignmentCenter);
-#endif
-    text_layer_set_overflow_mode(s_poem_layer, GTextOverflowModeWordWrap);
-    //text_layer_set_text(s_poem_layer, "This is a longish poem just a test nothing more. And here is some more text it's super long isn't it there just isn't much else that we can do here. Oh but we can continue going can't we and make this as long as we'd like oh yes we can oh yes we can we just continue going and going and going like that bunny yes we can oh yes yes yes.");
-    //text_layer_set_text(s_poem_layer, "This is a longish poem just a test nothing more. ");
-    text_layer_set_text(s_poem_layer, "Waiting to know the objects above...");
-    text_layer_set_font(s_poem_layer, s_poem_font);
+    if (!visible) {
+        timeline_pause();
+        cancel_page_transition();
+        return;
+    }
 
+    // Catch up on any poem whose window started while we were hidden
+    show_current_poem();
+    if (s_poem_layer) {
+        layer_mark_dirty(s_poem_layer);
+    }
+    timeline_resume();
+    if (poem_is_stale()) {
+        request_poem();
+    }
+}
 
+/*
+ * The battery has crossed a threshold; the new timings apply from the next step or page
+ */
+static void power_level_handler(PowerLevel level) {
+    trace_event(TRACE_POWER_LEVEL, level);
+}
 
+/*
+ * Set up window, layers, and fonts
+ */
+static void main_window_load(Window *window) {
+    uint32_t start = diagnostics_clock();
+
+    // Get information about the window
+    window_layer = window_get_root_layer(window);
+
+    // Create time GFont
+    s_time_font = font_cache_get(RESOURCE_ID_FONT_ANDIKA_20);
+    //s_time_font = font_cache_get(RESOURCE_ID_FONT_DELICIOUS_20);
+    s_charis_font = font_cache_get(RESOURCE_ID_FONT_CHARIS_SIL_24);
+
+    // Title and poem layers, and their fonts, are created by the timeline
+    // when they're needed
 
     // Create the text layer with specific bounds
-    s_time_layer = text_layer_create(
-            GRect(margin, PBL_IF_ROUND_ELSE(144, 144), bounds.size.w - (2 * margin), 20));
+    s_time_layer = text_layer_create(LAYOUT_TIME_RECT);
 
     // Improve the layout to be more like a watchface
     text_layer_set_background_color(s_time_layer, GColorClear);
@@ -457,35 +546,24 @@ static void main_window_load(Window *window) {
     text_layer_set_text_alignment(s_time_layer, GTextAlignmentCenter);
 
 
-    // Add layers for display
-    scroll_layer_add_child(s_scroll_layer, text_layer_get_layer(s_poem_layer));
-
-    // Add poem layer to window
-    //layer_add_child(window_get_root_layer(window), text_layer_get_layer(s_poem_layer));
-    
-
-    // Get sizes of text layer and update scroll layer content size
-    //GSize content_size = text_layer_get_content_size(s_poem_layer);
-    //text_layer_set_size(s_poem_layer, content_size);
-    //scroll_layer_set_content_size(s_scroll_layer, GSize(bounds.size.w, content_size.h + 4));
-
-
     // Add it as a child layer to the Window's root layer
     layer_add_child(window_layer, text_layer_get_layer(s_time_layer));
 
-    // Add scroll layer to window
-    layer_add_child(window_layer, scroll_layer_get_layer(s_scroll_layer));
-    hide_scroll_layer();
-
-#if defined(PBL_ROUND)
-    text_layer_enable_screen_text_flow_and_paging(s_poem_layer, 4);
-#endif
+    // Show the poem for now from our batch or, failing that, the last one we
+    // were sent, while we wait for a new one
+    show_current_poem();
+    if (s_current_slot < 0) {
+        char *cached_title, *cached_poem;
+        if (poem_cache_load(poem_cache_newest(), &cached_title, &cached_poem)) {
+            set_poem(cached_poem, cached_title);
+            s_current_slot = poem_cache_newest();
+        }
+    }
 
-    // Create default title
-    snprintf(title_layer_buffer, sizeof(title_layer_buffer), "%s", default_title);
+    // Start the timeline; from here on each step arms its own deadline
+    timeline_start();
 
-    // Register state timer callback
-    stateTimer = app_timer_register(TIMER_PERIOD, (AppTimerCallback) stateTimerCallback, NULL);
+    diagnostics_record(DIAG_WINDOW_LOAD, start);
 }
 
 /*
@@ -496,68 +574,216 @@ static void main_window_unload(Window *window) {
     text_layer_destroy(s_time_layer);
 
     // Unload GFont
-    fonts_unload_custom_font(s_time_font);
-
-    // Destroy poem elements
-    text_layer_destroy(s_poem_layer);
-    fonts_unload_custom_font(s_poem_font);
+    font_cache_release(s_time_font);
+    font_cache_release(s_charis_font);
+
+    // Stop the timeline, then destroy poem and title elements if it left any
+    timeline_stop();
+    destroy_poem_layer();
+    destroy_title_layer();
+
+    // Free incoming text now that nothing points at it
+    free(s_poem_text);
+    s_poem_text = NULL;
+    free(s_title_text);
+    s_title_text = NULL;
+    free(s_pending_title);
+    s_pending_title = NULL;
+    poem_chunks_reset(&s_poem_chunks);
+
+    // Stop any pass search, since its poem would have nowhere to go
+    sat_predict_cancel();
+}
 
-    // Destroy scroll layer
-    scroll_layer_destroy(s_scroll_layer);
+/*
+ * Copy a string tuple into a freshly allocated buffer of exactly the right size
+ * Returns NULL if we couldn't get the memory
+ */
+static char *copy_tuple_text(const Tuple *tuple) {
+    char *text = malloc(tuple->length + 1);
+    if (text) {
+        memcpy(text, tuple->value->cstring, tuple->length);
+        text[tuple->length] = '\0';
+    }
+    return text;
+}
 
-    // Destroy title elements
-    text_layer_destroy(s_title_layer);
-    fonts_unload_custom_font(s_title_font);
+/*
+ * Show a new poem and title, taking ownership of both strings
+ */
+static void set_poem(char *poem_text, char *title_text) {
+    // Same words as we're already showing, so keep the page we're on and skip the relayout
+    uint32_t hash = transport_hash(title_text, poem_text);
+    if (hash == s_poem_hash && s_poem_text) {
+        LOG_DEBUG("Poem unchanged");
+        free(poem_text);
+        free(title_text);
+        return;
+    }
+    s_poem_hash = hash;
+
+    // Point the layers at the new text before letting go of the old
+    // The poem is wrapped once, when it's next shown, starting from its first page
+    free(s_poem_text);
+    s_poem_text = poem_text;
+    s_poem_pages_stale = true;
+    s_current_page = 0;
+    if (s_poem_layer) {
+        cancel_page_transition();
+        layout_poem();
+        layer_mark_dirty(s_poem_layer);
+    }
 
-    // Destroy timer
-    app_timer_cancel(stateTimer);
+    if (s_title_layer) {
+        text_layer_set_text(s_title_layer, title_text);
+    }
+    free(s_title_text);
+    s_title_text = title_text;
+    LOG_DEBUG("TITLE: %s", s_title_text);
 }
 
 /*
  * Handle incoming data from phone/javascript
+ *
+ * A poem arrives as one message with TITLE and POEM_LENGTH, followed by
+ * POEM_SEQ/POEM chunk messages; see poem-chunks.h
  */
 static void inbox_received_callback(DictionaryIterator *iterator, void *context) {
     // Read tuples for data
-    Tuple *poem_tuple = dict_find(iterator, MESSAGE_KEY_POEM);
     Tuple *title_tuple = dict_find(iterator, MESSAGE_KEY_TITLE);
+    Tuple *length_tuple = dict_find(iterator, MESSAGE_KEY_POEM_LENGTH);
+    Tuple *wire_length_tuple = dict_find(iterator, MESSAGE_KEY_POEM_WIRE_LENGTH);
+    Tuple *seq_tuple = dict_find(iterator, MESSAGE_KEY_POEM_SEQ);
+    Tuple *poem_tuple = dict_find(iterator, MESSAGE_KEY_POEM);
+    Tuple *location_tuple = dict_find(iterator, MESSAGE_KEY_POEM_LOCATION);
+    Tuple *valid_from_tuple = dict_find(iterator, MESSAGE_KEY_POEM_VALID_FROM);
+    Tuple *valid_until_tuple = dict_find(iterator, MESSAGE_KEY_POEM_VALID_UNTIL);
+    Tuple *ready_tuple = dict_find(iterator, MESSAGE_KEY_READY);
+    Tuple *trace_tuple = dict_find(iterator, MESSAGE_KEY_TRACE_DUMP);
+    Tuple *elements_tuple = dict_find(iterator, MESSAGE_KEY_SAT_ELEMENTS);
+    Tuple *lat_tuple = dict_find(iterator, MESSAGE_KEY_OBSERVER_LAT);
+    Tuple *lon_tuple = dict_find(iterator, MESSAGE_KEY_OBSERVER_LON);
+    Tuple *hash_tuple = dict_find(iterator, MESSAGE_KEY_POEM_HASH);
+    Tuple *unchanged_tuple = dict_find(iterator, MESSAGE_KEY_POEM_UNCHANGED);
+    Tuple *timeline_tuple = dict_find(iterator, MESSAGE_KEY_TIMELINE);
+
+    trace_event(TRACE_INBOX, dict_size(iterator));
+
+    // The phone didn't hear our ack last time, and we've already dealt with this
+    if (transport_is_duplicate(iterator)) {
+        return;
+    }
 
+    // The phone wants to see what we've been up to
+    if (trace_tuple) {
+        trace_dump_begin();
+    }
 
-    if (poem_tuple && title_tuple) {
-        APP_LOG(APP_LOG_LEVEL_INFO, "HAVE POEM TUPLE");
-        snprintf(poem_buffer, sizeof(poem_buffer), "%s", poem_tuple->value->cstring);
-        snprintf(title_buffer, sizeof(title_buffer), "%s", title_tuple->value->cstring);
-
+    // A new presentation timeline, or an empty one to go back to ours
+    if (timeline_tuple) {
+        timeline_set_steps(timeline_tuple->value->data, timeline_tuple->length);
+    }
 
-        // Assemble string and display
-        snprintf(poem_layer_buffer, sizeof(poem_layer_buffer), "%s", poem_buffer);
-        text_layer_set_text(s_poem_layer, poem_layer_buffer);
+    // Orbital elements and location for writing our own poems
+    if (lat_tuple && lon_tuple) {
+        sat_predict_set_observer(lat_tuple->value->int32, lon_tuple->value->int32);
+    }
+    if (elements_tuple) {
+        sat_predict_set_elements(elements_tuple->value->data, elements_tuple->length);
+    }
 
-        // Assemble title string
-        snprintf(title_layer_buffer, sizeof(title_layer_buffer), "%s", title_buffer);
-        text_layer_set_text(s_title_layer, title_layer_buffer);
-        APP_LOG(APP_LOG_LEVEL_INFO, "TITLE: %s", title_buffer);
+    // READY and poem headers say where the phone is; poems cached for anywhere else are no use
+    if (location_tuple) {
+        uint32_t location = location_tuple->value->uint32;
+        uint32_t current_location = poem_cache_location(s_current_slot);
+        if (current_location != 0 && current_location != location) {
+            s_current_slot = -1;
+        }
+        poem_cache_forget_elsewhere(location);
+    }
 
-        // TODO
-        // Calculate all of this properly based off of the size of the text + descenders and such
-        //GSize content_size = text_layer_get_content_size(s_poem_layer);
-    GSize content_size = graphics_text_layout_get_content_size(
-            text_layer_get_text(s_poem_layer),
-            s_poem_font,
-            GRect(0, 0, bounds.size.w - (margin * 2), 5000),
-            GTextAlignmentLeft,
-            GTextOverflowModeWordWrap);
+    // The phone is ready to talk; only bother it if our cached poem is too old
+    if (ready_tuple && poem_is_stale()) {
+        request_poem();
+    }
 
-        // TODO: REMEMBER that we have to add the descender height to the total content size height
-        content_size.h = content_size.h + 8 + 20;
-        GPoint content_offset = scroll_layer_get_content_offset(s_scroll_layer);
-        text_layer_set_size(s_poem_layer, content_size);
-        scroll_layer_set_content_size(s_scroll_layer, GSize(bounds.size.w, scrollSize * (((int)content_size.h/scrollSize) + 1)));
+    // The poem we asked with is still the current one; it's good until the next refresh
+    if (unchanged_tuple) {
+        time_t valid_until = time(NULL) + power_policy_poem_period(poemPeriod) * 60;
+        LOG_INFO("Poem unchanged, keeping it");
+        trace_event(TRACE_POEM_UNCHANGED, 0);
+        if (s_current_slot >= 0) {
+            poem_cache_extend(s_current_slot, valid_until);
+        } else {
+            s_next_prediction = valid_until;
+            if (s_uncached_until) {
+                s_uncached_until = valid_until;
+            }
+        }
+    }
 
-        APP_LOG(APP_LOG_LEVEL_INFO, "initial y content offset: %d", (int)content_offset.y);
-        APP_LOG(APP_LOG_LEVEL_INFO, "initial y content size: %d", (int)content_size.h);
-        APP_LOG(APP_LOG_LEVEL_INFO, "total size of content: %d", scrollSize * (((int)content_size.h/scrollSize) + 1));
+    // The phone is sending the rest of a poem we have part of, so keep the chunks we've got
+    uint32_t hash = hash_tuple ? hash_tuple->value->uint32 : 0;
+    if (title_tuple && length_tuple && hash != 0 && hash == s_pending_hash && s_poem_chunks.text) {
+        LOG_INFO("Resuming poem of %d bytes", (int)length_tuple->value->uint16);
+    } else if (title_tuple && length_tuple) {
+        LOG_INFO("Starting poem of %d bytes", (int)length_tuple->value->uint16);
+        s_pending_hash = hash;
+        free(s_pending_title);
+        s_pending_title = NULL;
+        s_pending_location = location_tuple ? location_tuple->value->uint32 : 0;
+
+        // Poems without a window are good from now until the next refresh
+        s_pending_valid_from = valid_from_tuple ? (time_t)valid_from_tuple->value->uint32 : time(NULL);
+        s_pending_valid_until = valid_until_tuple ? (time_t)valid_until_tuple->value->uint32 : s_pending_valid_from + power_policy_poem_period(poemPeriod) * 60;
+
+        // Without a wire length the poem is sent as plain text
+        uint16_t length = length_tuple->value->uint16;
+        uint16_t wire_length = wire_length_tuple ? wire_length_tuple->value->uint16 : length;
+
+        if (poem_chunks_begin(&s_poem_chunks, length, wire_length)) {
+            s_pending_title = copy_tuple_text(title_tuple);
+            if (!s_pending_title) {
+                LOG_ERROR("Not enough memory for title");
+                poem_chunks_reset(&s_poem_chunks);
+            }
+        }
+    }
 
+    if (seq_tuple && poem_tuple) {
+        if (!poem_chunks_add(&s_poem_chunks, seq_tuple->value->uint8, poem_tuple->value->data, poem_tuple->length)) {
+            LOG_WARNING("Ignoring chunk %d", (int)seq_tuple->value->uint8);
+            return;
+        }
+        trace_event(TRACE_POEM_CHUNK, seq_tuple->value->uint8);
+
+        if (poem_chunks_complete(&s_poem_chunks)) {
+            LOG_INFO("HAVE POEM");
+            char *title_text = s_pending_title;
+            char *poem_text = poem_chunks_take(&s_poem_chunks);
+            s_pending_title = NULL;
+            if (!poem_text) {
+                free(title_text);
+                return;
+            }
 
+            int slot = poem_cache_store(title_text, poem_text, s_pending_location, s_pending_valid_from, s_pending_valid_until);
+            time_t now = time(NULL);
+
+            // Show it straight away if it's the one for now, otherwise it waits in the cache
+            if ((slot >= 0 && slot == poem_cache_find(now)) ||
+                    (slot < 0 && s_pending_valid_from <= now && now < s_pending_valid_until)) {
+                set_poem(poem_text, title_text);
+                s_current_slot = slot;
+                s_uncached_until = slot < 0 ? s_pending_valid_until : 0;
+                if (slot < 0) {
+                    s_next_prediction = s_pending_valid_until;
+                }
+            } else {
+                free(poem_text);
+                free(title_text);
+            }
+        }
     }
 }
 
@@ -565,21 +791,35 @@ static void inbox_received_callback(DictionaryIterator *iterator, void *context)
  * Deal with callback and inbox issues
  */
 static void inbox_dropped_callback(AppMessageResult reason, void *context) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Message dropped! Reason: %d", (int)reason);
+    LOG_ERROR("Message dropped! Reason: %d", (int)reason);
+    trace_event(TRACE_INBOX_DROPPED, reason);
 }
 
 static void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox send failed!");
+    LOG_ERROR("Outbox send failed!");
+    trace_event(TRACE_OUTBOX_FAILED, reason);
+    transport_outbox_failed(iterator, reason);
+    trace_dump_failed(iterator);
 }
 
 static void outbox_sent_callback(DictionaryIterator *iterator, void *context) {
-    APP_LOG(APP_LOG_LEVEL_INFO, "Outbox send success!");
+    LOG_DEBUG("Outbox send success!");
+    transport_outbox_sent(iterator);
+
+    // Keep a trace dump going, one message at a time
+    trace_dump_continue();
 }
 
 /*
  * Initialize window, callbacks, handlers
  */
 static void init() {
+    // Read cached poem headers before the window loads and looks for one to show
+    poem_cache_init();
+    power_policy_init(power_level_handler);
+    timeline_init(s_default_timeline, ARRAY_LENGTH(s_default_timeline), &s_timeline_hooks);
+    sat_predict_init();
+
     s_main_window = window_create();
 
     window_set_window_handlers(s_main_window, (WindowHandlers) {
@@ -590,10 +830,14 @@ static void init() {
     window_set_background_color(s_main_window, GColorBlack);
 
     // Only one subscription to this service is allowed
-    tick_timer_service_subscribe(SECOND_UNIT, tick_handler_seconds);
+    // Minute ticks are all we need for the clock and poem refresh
+    tick_timer_service_subscribe(MINUTE_UNIT, tick_handler_minutes);
 
     window_stack_push(s_main_window, true);
 
+    // After the window is up, so the state machine is running if we start out hidden
+    visibility_init(visibility_handler);
+
     // Register callbacks
     app_message_register_inbox_received(inbox_received_callback);
     app_message_register_inbox_dropped(inbox_dropped_callback);
@@ -601,8 +845,10 @@ static void init() {
     app_message_register_outbox_sent(outbox_sent_callback);
 
     // Open AppMessage
-    const int inbox_size = 4096;
-    const int outbox_size = 4096;
+    // Poems arrive in POEM_CHUNK_SIZE pieces, so we only need room for one
+    // chunk (or a title) plus the dictionary overhead
+    const int inbox_size = 512;
+    const int outbox_size = 64;
     app_message_open(inbox_size, outbox_size);
 
     // Make sure the time is displayed from the start
@@ -613,6 +859,10 @@ static void init() {
  * Destroy window
  */
 static void deinit() {
+    transport_cancel();
+    visibility_deinit();
+    power_policy_deinit();
+
     // Destroy window
     window_destroy(s_main_window);
 }
@@ -0,0 +1,417 @@
+#include "sat-predict.h"
+#include "logging.h"
+
+#define PI 3.14159265f
+#define TWO_PI 6.28318531f
+#define DEG_PER_RAD 57.2957795f
+
+#define MU 398600.4418f // km^3/s^2
+#define EARTH_RADIUS 6378.137f // km
+#define J2 1.08262668e-3f
+#define J2000 946728000 // 2000-01-01 12:00 UTC
+
+#define KEY_ELEMENTS SAT_PREDICT_PERSIST_KEY
+#define KEY_OBSERVER (SAT_PREDICT_PERSIST_KEY + 1)
+
+// Orbit derived from the elements, ready to propagate
+typedef struct {
+    char name[sizeof(((SatElements *)0)->name) + 1];
+    time_t epoch;
+    float n; // mean motion, rad/s
+    float a; // semi-major axis, km
+    float e;
+    float sqrt_1me2;
+    float sin_i, cos_i;
+    float raan, raan_rate;
+    float argp, argp_rate;
+    float m0, m_rate;
+} SatOrbit;
+
+typedef struct {
+    time_t rise, set;
+    int16_t max_elevation;
+    int16_t rise_azimuth, set_azimuth;
+    uint8_t sat;
+} SatPass;
+
+static SatOrbit s_orbits[SAT_PREDICT_MAX_SATS];
+static uint8_t s_num_orbits = 0;
+
+// Observer position in km, earth fixed, and the trig we need for topocentric coordinates
+static bool s_have_observer = false;
+static float s_obs[3];
+static float s_sin_lat, s_cos_lat, s_sin_lon, s_cos_lon;
+
+// State of a search in progress
+static AppTimer *s_timer = NULL;
+static SatPredictCallback s_callback = NULL;
+static time_t s_start;
+static uint8_t s_next_sat;
+static SatPass s_passes[SAT_PREDICT_MAX_SATS];
+static uint8_t s_num_passes;
+
+/*
+ * Trig in radians on top of the SDK's lookup tables
+ */
+static int32_t trig_angle(float rad) {
+    return ((int32_t)(rad * (TRIG_MAX_ANGLE / TWO_PI))) & (TRIG_MAX_ANGLE - 1);
+}
+
+static float trig_sin(float rad) {
+    return (float)sin_lookup(trig_angle(rad)) / TRIG_MAX_RATIO;
+}
+
+static float trig_cos(float rad) {
+    return (float)cos_lookup(trig_angle(rad)) / TRIG_MAX_RATIO;
+}
+
+// Angle of (x, y) in degrees, 0 to 360
+static float trig_atan2_deg(float y, float x) {
+    float ay = y < 0 ? -y : y;
+    float ax = x < 0 ? -x : x;
+    float m = ay > ax ? ay : ax;
+    if (m == 0) {
+        return 0;
+    }
+    int32_t angle = atan2_lookup((int16_t)(y / m * 32767), (int16_t)(x / m * 32767));
+    float degrees = (float)angle * 360.0f / TRIG_MAX_ANGLE;
+    return degrees < 0 ? degrees + 360 : degrees;
+}
+
+static float newton_sqrt(float x) {
+    if (x <= 0) {
+        return 0;
+    }
+    float r = x > 1 ? x / 2 : 1;
+    for (int i = 0; i < 20; i++) {
+        r = 0.5f * (r + x / r);
+    }
+    return r;
+}
+
+static float wrap_two_pi(float rad) {
+    return rad - TWO_PI * (int32_t)(rad / TWO_PI);
+}
+
+/*
+ * Unpack elements into an orbit we can propagate
+ */
+static void orbit_from_elements(SatOrbit *orbit, const SatElements *elements) {
+    memcpy(orbit->name, elements->name, sizeof(elements->name));
+    orbit->name[sizeof(elements->name)] = '\0';
+
+    orbit->epoch = (time_t)elements->epoch;
+    orbit->n = (elements->mean_motion / 1e6f) * TWO_PI / 86400.0f;
+    orbit->e = elements->eccentricity / 65536.0f;
+    orbit->sqrt_1me2 = newton_sqrt(1 - orbit->e * orbit->e);
+
+    // a^3 = mu / n^2, by Newton's method from a low earth orbit guess
+    float c = MU / (orbit->n * orbit->n);
+    float a = 7000;
+    for (int i = 0; i < 20; i++) {
+        a = a - (a * a * a - c) / (3 * a * a);
+    }
+    orbit->a = a;
+
+    float i = elements->inclination * TWO_PI / TRIG_MAX_ANGLE;
+    orbit->sin_i = trig_sin(i);
+    orbit->cos_i = trig_cos(i);
+    orbit->raan = elements->raan * TWO_PI / TRIG_MAX_ANGLE;
+    orbit->argp = elements->arg_perigee * TWO_PI / TRIG_MAX_ANGLE;
+    orbit->m0 = elements->mean_anomaly * TWO_PI / TRIG_MAX_ANGLE;
+
+    // Secular drift of the node, perigee and mean anomaly from the earth's oblateness
+    float p = a * (1 - orbit->e * orbit->e);
+    float k = 1.5f * orbit->n * J2 * (EARTH_RADIUS / p) * (EARTH_RADIUS / p);
+    orbit->raan_rate = -k * orbit->cos_i;
+    orbit->argp_rate = 0.5f * k * (5 * orbit->cos_i * orbit->cos_i - 1);
+    orbit->m_rate = orbit->n + 0.5f * k * orbit->sqrt_1me2 * (3 * orbit->cos_i * orbit->cos_i - 1);
+}
+
+/*
+ * Position in earth fixed coordinates (km) at time t
+ */
+static void orbit_position(const SatOrbit *orbit, time_t t, float pos[3]) {
+    float dt = (float)(t - orbit->epoch);
+
+    // Solve Kepler's equation for the eccentric anomaly
+    float m = wrap_two_pi(orbit->m0 + orbit->m_rate * dt);
+    float ea = m;
+    for (int i = 0; i < 4; i++) {
+        ea = ea - (ea - orbit->e * trig_sin(ea) - m) / (1 - orbit->e * trig_cos(ea));
+    }
+    float xp = orbit->a * (trig_cos(ea) - orbit->e);
+    float yp = orbit->a * orbit->sqrt_1me2 * trig_sin(ea);
+
+    // Rotate out of the orbital plane into inertial coordinates
+    float argp = orbit->argp + orbit->argp_rate * dt;
+    float raan = orbit->raan + orbit->raan_rate * dt;
+    float sw = trig_sin(argp), cw = trig_cos(argp);
+    float so = trig_sin(raan), co = trig_cos(raan);
+
+    float x = xp * (cw * co - sw * so * orbit->cos_i) - yp * (sw * co + cw * so * orbit->cos_i);
+    float y = xp * (cw * so + sw * co * orbit->cos_i) + yp * (cw * co * orbit->cos_i - sw * so);
+    float z = xp * (sw * orbit->sin_i) + yp * (cw * orbit->sin_i);
+
+    // And then by sidereal time into earth fixed coordinates. Whole days and
+    // the fraction are kept apart so a float doesn't lose the fraction.
+    int32_t since = (int32_t)(t - J2000);
+    int32_t days = since / 86400;
+    float fraction = (float)(since - days * 86400) / 86400.0f;
+    float gmst_deg = 280.46061837f + 0.98564736629f * days + 360.98564736629f * fraction;
+    float gmst = wrap_two_pi(gmst_deg / DEG_PER_RAD);
+    float st = trig_sin(gmst), ct = trig_cos(gmst);
+
+    pos[0] = x * ct + y * st;
+    pos[1] = -x * st + y * ct;
+    pos[2] = z;
+}
+
+/*
+ * Elevation and azimuth in degrees of a satellite from the observer
+ */
+static void look_angles(const SatOrbit *orbit, time_t t, float *elevation, float *azimuth) {
+    float pos[3];
+    orbit_position(orbit, t, pos);
+
+    float rx = pos[0] - s_obs[0];
+    float ry = pos[1] - s_obs[1];
+    float rz = pos[2] - s_obs[2];
+
+    float east = -s_sin_lon * rx + s_cos_lon * ry;
+    float north = -s_sin_lat * s_cos_lon * rx - s_sin_lat * s_sin_lon * ry + s_cos_lat * rz;
+    float up = s_cos_lat * s_cos_lon * rx + s_cos_lat * s_sin_lon * ry + s_sin_lat * rz;
+
+    *elevation = trig_atan2_deg(up, newton_sqrt(east * east + north * north));
+    if (*elevation > 180) {
+        *elevation -= 360;
+    }
+    *azimuth = trig_atan2_deg(east, north);
+}
+
+/*
+ * Find the first pass of a satellite high enough to write about
+ */
+static bool find_pass(uint8_t sat, time_t start, SatPass *pass) {
+    const SatOrbit *orbit = &s_orbits[sat];
+    bool up = false;
+    float elevation, azimuth;
+
+    pass->sat = sat;
+    for (int step = 0; step <= SAT_PREDICT_HOURS * 3600 / SAT_PREDICT_STEP; step++) {
+        time_t t = start + step * SAT_PREDICT_STEP;
+        look_angles(orbit, t, &elevation, &azimuth);
+
+        if (!up && elevation > 0) {
+            up = true;
+            pass->rise = t;
+            pass->rise_azimuth = (int16_t)azimuth;
+            pass->max_elevation = (int16_t)elevation;
+        } else if (up && elevation > 0) {
+            if (elevation > pass->max_elevation) {
+                pass->max_elevation = (int16_t)elevation;
+            }
+        } else if (up) {
+            up = false;
+            pass->set = t;
+            pass->set_azimuth = (int16_t)azimuth;
+            if (pass->max_elevation >= SAT_PREDICT_MIN_ELEVATION) {
+                return true;
+            }
+        }
+    }
+
+    // Still up at the end of the window, so call that the end of the pass
+    if (up && pass->max_elevation >= SAT_PREDICT_MIN_ELEVATION) {
+        pass->set = start + SAT_PREDICT_HOURS * 3600;
+        pass->set_azimuth = (int16_t)azimuth;
+        return true;
+    }
+    return false;
+}
+
+static const char *compass_point(int16_t azimuth) {
+    static const char *const points[] = {
+        "north", "northeast", "east", "southeast", "south", "southwest", "west", "northwest"
+    };
+    return points[((azimuth + 22) / 45) % 8];
+}
+
+/*
+ * Write up the passes we found, soonest first
+ */
+static char *write_poem(void) {
+    const size_t size = 128 + s_num_passes * 160;
+    char *poem = malloc(size);
+    if (!poem) {
+        return NULL;
+    }
+
+    // Insertion sort by rise time; there are only a handful
+    for (int i = 1; i < s_num_passes; i++) {
+        SatPass pass = s_passes[i];
+        int j = i - 1;
+        while (j >= 0 && s_passes[j].rise > pass.rise) {
+            s_passes[j + 1] = s_passes[j];
+            j--;
+        }
+        s_passes[j + 1] = pass;
+    }
+
+    size_t used = 0;
+    if (s_num_passes == 0) {
+        used = snprintf(poem, size, "Nothing passes high overhead\nin the next %d hours.\n\nThe sky keeps its own counsel.", SAT_PREDICT_HOURS);
+    }
+
+    for (int i = 0; i < s_num_passes && used < size; i++) {
+        const SatPass *pass = &s_passes[i];
+        char rise[8], set[8];
+        strftime(rise, sizeof(rise), clock_is_24h_style() ? "%H:%M" : "%I:%M", localtime(&pass->rise));
+        strftime(set, sizeof(set), clock_is_24h_style() ? "%H:%M" : "%I:%M", localtime(&pass->set));
+
+        used += snprintf(poem + used, size - used, "%s%s rises in the %s at %s,\nclimbs to %d degrees,\nand sets in the %s at %s.",
+                i > 0 ? "\n\n" : "",
+                s_orbits[pass->sat].name,
+                compass_point(pass->rise_azimuth), rise,
+                (int)pass->max_elevation,
+                compass_point(pass->set_azimuth), set);
+    }
+
+    return poem;
+}
+
+static void search_callback(void *data) {
+    s_timer = NULL;
+
+    if (s_next_sat < s_num_orbits) {
+        if (find_pass(s_next_sat, s_start, &s_passes[s_num_passes])) {
+            s_num_passes++;
+        }
+        s_next_sat++;
+        s_timer = app_timer_register(10, search_callback, NULL);
+        return;
+    }
+
+    char *poem = write_poem();
+    char *title = malloc(sizeof("SATELLITES ABOVE"));
+    if (!poem || !title) {
+        LOG_ERROR("Not enough memory for predicted poem");
+        free(poem);
+        free(title);
+        return;
+    }
+    strcpy(title, "SATELLITES ABOVE");
+
+    LOG_INFO("Predicted %d passes", (int)s_num_passes);
+    s_callback(title, poem);
+}
+
+/*
+ * Unpack packed SatElements into orbits, skipping empty records
+ * If kept isn't NULL the records we used are copied there, one after another
+ */
+static void use_elements(const uint8_t *data, uint16_t size, SatElements *kept) {
+    sat_predict_cancel();
+
+    s_num_orbits = 0;
+    for (uint16_t offset = 0; offset + sizeof(SatElements) <= size && s_num_orbits < SAT_PREDICT_MAX_SATS; offset += sizeof(SatElements)) {
+        SatElements elements;
+        memcpy(&elements, data + offset, sizeof(elements));
+        if (elements.mean_motion == 0) {
+            continue;
+        }
+        if (kept) {
+            kept[s_num_orbits] = elements;
+        }
+        orbit_from_elements(&s_orbits[s_num_orbits++], &elements);
+    }
+    LOG_INFO("Have elements for %d satellites", (int)s_num_orbits);
+}
+
+/*
+ * Observer location in ten thousandths of a degree, east longitude
+ */
+static void use_observer(int32_t lat, int32_t lon) {
+    float phi = (lat / 10000.0f) / DEG_PER_RAD;
+    float lambda = (lon / 10000.0f) / DEG_PER_RAD;
+
+    s_sin_lat = trig_sin(phi);
+    s_cos_lat = trig_cos(phi);
+    s_sin_lon = trig_sin(lambda);
+    s_cos_lon = trig_cos(lambda);
+    s_obs[0] = EARTH_RADIUS * s_cos_lat * s_cos_lon;
+    s_obs[1] = EARTH_RADIUS * s_cos_lat * s_sin_lon;
+    s_obs[2] = EARTH_RADIUS * s_sin_lat;
+    s_have_observer = true;
+}
+
+/*
+ * Load whatever elements and location the phone last sent us
+ * They're already in storage, so nothing is written back
+ */
+void sat_predict_init(void) {
+    uint8_t data[SAT_PREDICT_MAX_SATS * sizeof(SatElements)];
+    int size = persist_read_data(KEY_ELEMENTS, data, sizeof(data));
+    s_num_orbits = 0;
+    if (size > 0) {
+        use_elements(data, size, NULL);
+    }
+
+    int32_t observer[2];
+    if (persist_read_data(KEY_OBSERVER, observer, sizeof(observer)) == sizeof(observer)) {
+        use_observer(observer[0], observer[1]);
+    }
+}
+
+/*
+ * Take a new set of packed SatElements from the phone, and keep the ones we
+ * can use for next time
+ */
+void sat_predict_set_elements(const uint8_t *data, uint16_t size) {
+    SatElements kept[SAT_PREDICT_MAX_SATS];
+    use_elements(data, size, kept);
+
+    if (s_num_orbits > 0) {
+        persist_write_data(KEY_ELEMENTS, kept, s_num_orbits * sizeof(SatElements));
+    } else {
+        persist_delete(KEY_ELEMENTS);
+    }
+}
+
+/*
+ * Take the observer's location from the phone, and keep it for next time
+ */
+void sat_predict_set_observer(int32_t lat, int32_t lon) {
+    use_observer(lat, lon);
+
+    int32_t observer[2] = { lat, lon };
+    persist_write_data(KEY_OBSERVER, observer, sizeof(observer));
+}
+
+bool sat_predict_ready(void) {
+    return s_have_observer && s_num_orbits > 0;
+}
+
+/*
+ * Start searching for passes from start onwards; callback gets the poem
+ * Returns false if we can't, or a search is already running
+ */
+bool sat_predict_generate(time_t start, SatPredictCallback callback) {
+    if (!sat_predict_ready() || s_timer) {
+        return false;
+    }
+
+    s_callback = callback;
+    s_start = start;
+    s_next_sat = 0;
+    s_num_passes = 0;
+    s_timer = app_timer_register(10, search_callback, NULL);
+    return true;
+}
+
+void sat_predict_cancel(void) {
+    if (s_timer) {
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+}
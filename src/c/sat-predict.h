@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * On-watch prediction of satellite passes, so we can write a poem about the
+ * sky without asking the phone
+ *
+ * The phone occasionally sends compact orbital elements (SAT_ELEMENTS) and
+ * the observer's location (OBSERVER_LAT/OBSERVER_LON), which we keep in
+ * persistent storage. Orbits are propagated with a simplified two body model
+ * plus secular J2 drift of the node, perigee and mean anomaly: no drag or
+ * other perturbations, which is good enough to place a pass within a minute or
+ * two for a few days after the epoch. The host tests hold it to SGP4 passes
+ * worked out by test/reference-passes.js.
+ *
+ * Passes are searched one satellite per timer callback so no single callback
+ * runs for long.
+ */
+
+#define SAT_PREDICT_MAX_SATS 8
+#define SAT_PREDICT_HOURS 6 // how far ahead we look for passes
+#define SAT_PREDICT_STEP 60 // seconds between samples while searching
+#define SAT_PREDICT_MIN_ELEVATION 10 // degrees; lower passes aren't worth a poem
+
+// Persist keys SAT_PREDICT_PERSIST_KEY and SAT_PREDICT_PERSIST_KEY + 1 belong to us
+#define SAT_PREDICT_PERSIST_KEY 200
+
+// Elements for one satellite as packed by src/pkjs/index.js, little endian
+// Angles are in TRIG_MAX_ANGLE units, eccentricity in 1/65536ths
+typedef struct {
+    char name[12];
+    uint32_t epoch; // seconds since the Unix epoch
+    uint32_t mean_motion; // millionths of a revolution per day
+    uint16_t inclination;
+    uint16_t raan;
+    uint16_t eccentricity;
+    uint16_t arg_perigee;
+    uint16_t mean_anomaly;
+    uint16_t reserved;
+} SatElements;
+
+// Called with a freshly allocated title and poem, which the callee then owns
+typedef void (*SatPredictCallback)(char *title, char *poem);
+
+void sat_predict_init(void);
+void sat_predict_set_elements(const uint8_t *data, uint16_t size);
+void sat_predict_set_observer(int32_t lat, int32_t lon);
+bool sat_predict_ready(void);
+bool sat_predict_generate(time_t start, SatPredictCallback callback);
+void sat_predict_cancel(void);
@@ -0,0 +1,205 @@
+#include "timeline.h"
+#include "logging.h"
+#include "trace.h"
+
+static const TimelineStep *s_default_steps;
+static uint8_t s_num_default_steps;
+static TimelineHooks s_hooks;
+
+// Steps from the phone, used instead of the default when s_num_steps > 0
+static TimelineStep s_steps[TIMELINE_MAX_STEPS];
+static uint8_t s_num_steps = 0;
+
+static uint8_t s_current = 0;
+static bool s_running = false;
+static bool s_paused = false; // running, but with no timer armed until timeline_resume
+static AppTimer *s_timer = NULL;
+static uint32_t s_wakeups = 0; // for keeping an eye on power use
+
+static const TimelineStep *steps(uint8_t *count) {
+    if (s_num_steps > 0) {
+        *count = s_num_steps;
+        return s_steps;
+    }
+    *count = s_num_default_steps;
+    return s_default_steps;
+}
+
+static const TimelineStep *current_step(void) {
+    uint8_t count;
+    return &steps(&count)[s_current];
+}
+
+static bool run_action(uint8_t action) {
+    if (action == TIMELINE_NO_ACTION || action >= s_hooks.num_actions || !s_hooks.actions[action]) {
+        return false;
+    }
+    return s_hooks.actions[action]();
+}
+
+static void timer_callback(void *data);
+
+static void arm(void) {
+    if (s_timer) {
+        app_timer_cancel(s_timer);
+    }
+    s_timer = app_timer_register(s_hooks.dwell(current_step()->duration), timer_callback, NULL);
+}
+
+/*
+ * Move to a step, passing over optional ones if need be, and run its enter action
+ */
+static void enter(uint8_t index) {
+    uint8_t count;
+    const TimelineStep *all = steps(&count);
+
+    // Bounded, in case every step is optional
+    bool skip = s_hooks.skip_optional && s_hooks.skip_optional();
+    for (uint8_t i = 0; skip && i < count && (all[index].flags & TIMELINE_OPTIONAL); i++) {
+        index = all[index].next;
+    }
+
+    s_current = index;
+    trace_event(TRACE_STATE_ENTER, index);
+    if (index == 0) {
+        LOG_DEBUG("Timeline wakeups so far: %d", (int)s_wakeups);
+    }
+
+    run_action(all[index].enter);
+    if (!s_paused) {
+        arm();
+    }
+}
+
+static void timer_callback(void *data) {
+    s_timer = NULL;
+    s_wakeups++;
+    trace_event(TRACE_STATE_TIMER, s_current);
+
+    const TimelineStep *step = current_step();
+    if (run_action(step->repeat)) {
+        arm();
+        return;
+    }
+
+    run_action(step->exit);
+    enter(step->next);
+}
+
+/*
+ * Check a timeline from the phone hangs together: every next and action in range
+ */
+static bool valid(const TimelineStep *candidate, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        const TimelineStep *step = &candidate[i];
+        if (step->next >= count || step->duration == 0 ||
+                step->enter >= s_hooks.num_actions || step->exit >= s_hooks.num_actions ||
+                step->repeat >= s_hooks.num_actions) {
+            LOG_ERROR("Timeline step %d is invalid", (int)i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Set up with the built in timeline, or the phone's if it sent us one before
+ */
+void timeline_init(const TimelineStep *default_steps, uint8_t num_steps, const TimelineHooks *hooks) {
+    s_default_steps = default_steps;
+    s_num_default_steps = num_steps;
+    s_hooks = *hooks;
+
+    int size = persist_read_data(TIMELINE_PERSIST_KEY, s_steps, sizeof(s_steps));
+    s_num_steps = 0;
+    if (size > 0 && size % sizeof(TimelineStep) == 0 && valid(s_steps, size / sizeof(TimelineStep))) {
+        s_num_steps = size / sizeof(TimelineStep);
+        LOG_INFO("Using timeline of %d steps from the phone", (int)s_num_steps);
+    }
+}
+
+void timeline_start(void) {
+    s_running = true;
+    enter(0);
+}
+
+/*
+ * Leave the current step, running its exit action, and stop
+ */
+void timeline_stop(void) {
+    timeline_pause();
+    if (s_running) {
+        run_action(current_step()->exit);
+        s_running = false;
+    }
+    s_paused = false;
+}
+
+/*
+ * Stay on the current step without a timer armed until timeline_resume
+ */
+void timeline_pause(void) {
+    if (s_timer) {
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+    s_paused = s_running;
+}
+
+/*
+ * Carry on from the current step, with its full duration
+ */
+void timeline_resume(void) {
+    if (s_running) {
+        s_paused = false;
+        arm();
+    }
+}
+
+/*
+ * Take a new timeline from the phone, packed TimelineSteps; empty goes back to the default
+ * Restarts from the first step, which waits for timeline_resume if we're paused
+ */
+bool timeline_set_steps(const uint8_t *data, uint16_t size) {
+    uint8_t count = size / sizeof(TimelineStep);
+    if (size % sizeof(TimelineStep) != 0 || count > TIMELINE_MAX_STEPS) {
+        LOG_ERROR("Timeline of %d bytes doesn't fit", (int)size);
+        return false;
+    }
+
+    TimelineStep candidate[TIMELINE_MAX_STEPS];
+    memcpy(candidate, data, size);
+    if (!valid(candidate, count)) {
+        return false;
+    }
+
+    bool running = s_running;
+    bool paused = s_paused;
+    timeline_stop();
+
+    memcpy(s_steps, candidate, size);
+    s_num_steps = count;
+    if (count > 0) {
+        persist_write_data(TIMELINE_PERSIST_KEY, s_steps, size);
+    } else {
+        persist_delete(TIMELINE_PERSIST_KEY);
+    }
+    LOG_INFO("New timeline of %d steps", (int)count);
+
+    if (running) {
+        s_paused = paused;
+        timeline_start();
+    }
+    return true;
+}
+
+uint8_t timeline_step(void) {
+    return s_current;
+}
+
+/*
+ * Timer wakeups since the app started, one per step rather than one per poll
+ */
+uint32_t timeline_wakeups(void) {
+    return s_wakeups;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Table driven presentation timeline
+ *
+ * A timeline is a short list of steps. Each step runs its enter action,
+ * stays up for its duration and then runs its exit action before moving on
+ * to its next step, so a loop is just a step whose next points back. A step
+ * with a repeat action asks it at the end of each duration whether to stay
+ * for another (one more page of the poem, say). Optional steps are passed
+ * over while the skip hook says so.
+ *
+ * Actions are numbered, indexes into the table handed to timeline_init, so
+ * the phone can send a new timeline (TIMELINE, packed TimelineSteps) without
+ * any code changing. It's kept in persistent storage until the phone sends
+ * an empty one, which goes back to the built in default.
+ *
+ * Only one timer is ever armed, for the end of the current step.
+ */
+
+#define TIMELINE_MAX_STEPS 16
+
+// Persist key TIMELINE_PERSIST_KEY belongs to us
+#define TIMELINE_PERSIST_KEY 300
+
+#define TIMELINE_NO_ACTION 0 // action 0 is always "do nothing"
+
+#define TIMELINE_OPTIONAL 0x01 // step flag: pass over this step while the skip hook says so
+
+// One step as sent by the phone, little endian
+typedef struct {
+    uint16_t duration; // milliseconds
+    uint8_t enter;
+    uint8_t exit;
+    uint8_t repeat; // action whose result says whether to run the step again
+    uint8_t next; // index of the step after this one
+    uint8_t flags;
+    uint8_t reserved;
+} TimelineStep;
+
+// Returns whether to repeat, for repeat actions; ignored otherwise
+typedef bool (*TimelineAction)(void);
+
+typedef struct {
+    const TimelineAction *actions; // indexed by action number, [0] is unused
+    uint8_t num_actions;
+    uint32_t (*dwell)(uint32_t ms); // actual time to stay for a step's duration
+    bool (*skip_optional)(void);
+} TimelineHooks;
+
+void timeline_init(const TimelineStep *default_steps, uint8_t num_steps, const TimelineHooks *hooks);
+void timeline_start(void);
+void timeline_stop(void);
+void timeline_pause(void);
+void timeline_resume(void);
+bool timeline_set_steps(const uint8_t *data, uint16_t size);
+uint8_t timeline_step(void);
+uint32_t timeline_wakeups(void);
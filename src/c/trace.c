@@ -0,0 +1,90 @@
+#include "trace.h"
+
+#if SAT_TRACE
+
+// 8 bytes per event, packed as sent to the phone
+typedef struct {
+    uint32_t time; // milliseconds, wraps every 49 days
+    uint8_t id;
+    uint8_t reserved;
+    uint16_t arg;
+} TraceEvent;
+
+static TraceEvent s_events[TRACE_SIZE];
+static uint16_t s_next = 0; // where the next event goes
+static uint16_t s_count = 0;
+
+// Position of a dump in progress, counting back from the newest event
+static int16_t s_dump_remaining = -1;
+
+void trace_event(TraceEventId id, uint16_t arg) {
+    time_t seconds;
+    uint16_t ms;
+    time_ms(&seconds, &ms);
+
+    TraceEvent *event = &s_events[s_next];
+    event->time = (uint32_t)seconds * 1000 + ms;
+    event->id = id;
+    event->reserved = 0;
+    event->arg = arg;
+
+    s_next = (s_next + 1) % TRACE_SIZE;
+    if (s_count < TRACE_SIZE) {
+        s_count++;
+    }
+}
+
+/*
+ * Start sending the ring to the phone
+ */
+bool trace_dump_begin(void) {
+    s_dump_remaining = s_count;
+    return trace_dump_continue();
+}
+
+/*
+ * Send the next few events of a dump; call again once the last message was sent
+ * Returns false when there's nothing more to send
+ */
+bool trace_dump_continue(void) {
+    if (s_dump_remaining < 0) {
+        return false;
+    }
+
+    uint8_t data[TRACE_EVENTS_PER_MESSAGE * sizeof(TraceEvent)];
+    uint16_t n = 0;
+    while (s_dump_remaining > 0 && n < TRACE_EVENTS_PER_MESSAGE) {
+        uint16_t index = (s_next + TRACE_SIZE - s_dump_remaining) % TRACE_SIZE;
+        memcpy(data + n * sizeof(TraceEvent), &s_events[index], sizeof(TraceEvent));
+        s_dump_remaining--;
+        n++;
+    }
+
+    DictionaryIterator *iter;
+    if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+        s_dump_remaining = -1;
+        return false;
+    }
+
+    // Once everything has gone, a TRACE_DUMP message marks the end of the dump
+    if (n > 0) {
+        dict_write_data(iter, MESSAGE_KEY_TRACE, data, n * sizeof(TraceEvent));
+    } else {
+        dict_write_uint8(iter, MESSAGE_KEY_TRACE_DUMP, 0);
+        s_dump_remaining = -1;
+    }
+    app_message_outbox_send();
+    return true;
+}
+
+/*
+ * Give up on a dump whose message didn't get through, so it doesn't carry on
+ * from the middle when some other message is sent
+ */
+void trace_dump_failed(DictionaryIterator *iterator) {
+    if (dict_find(iterator, MESSAGE_KEY_TRACE) || dict_find(iterator, MESSAGE_KEY_TRACE_DUMP)) {
+        s_dump_remaining = -1;
+    }
+}
+
+#endif
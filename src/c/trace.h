@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Fixed size binary trace of what the watchface is doing, for timing
+ * visibility on real devices without formatting log messages
+ *
+ * Each event is an id, a millisecond timestamp and a small argument, kept in
+ * a ring of TRACE_SIZE entries. The phone can ask for a dump with TRACE_DUMP,
+ * and we send the ring back a few events per TRACE message, oldest first,
+ * followed by a TRACE_DUMP message to say we're done. If one of those doesn't
+ * get through the dump stops there, and the phone can ask again.
+ * Build with SAT_TRACE=0 to compile it all out.
+ */
+
+#ifndef SAT_TRACE
+#define SAT_TRACE 1
+#endif
+
+#define TRACE_SIZE 64
+#define TRACE_EVENTS_PER_MESSAGE 6 // keeps a dump message inside our small outbox
+
+typedef enum {
+    TRACE_STATE_ENTER = 1, // arg: state
+    TRACE_STATE_TIMER,     // arg: state
+    TRACE_PAGE,            // arg: page
+    TRACE_TICK,            // arg: minute
+    TRACE_POEM_REQUEST,
+    TRACE_POEM_CHUNK,      // arg: sequence number
+    TRACE_POEM_SET,        // arg: number of lines
+    TRACE_INBOX_DROPPED,   // arg: reason
+    TRACE_OUTBOX_FAILED,   // arg: reason
+    TRACE_PAGE_TRANSITION, // arg: frames drawn
+    TRACE_POWER_LEVEL,     // arg: PowerLevel
+    TRACE_VISIBILITY,      // arg: 1 if visible
+    TRACE_POEM_UNCHANGED,
+    TRACE_INBOX,           // arg: bytes received
+} TraceEventId;
+
+#if SAT_TRACE
+void trace_event(TraceEventId id, uint16_t arg);
+bool trace_dump_begin(void);
+bool trace_dump_continue(void);
+void trace_dump_failed(DictionaryIterator *iterator);
+#else
+#define trace_event(id, arg)
+#define trace_dump_begin() false
+#define trace_dump_continue() false
+#define trace_dump_failed(iterator)
+#endif
@@ -0,0 +1,113 @@
+#include "transport.h"
+#include "logging.h"
+
+static bool s_have_last_id = false;
+static uint32_t s_last_id = 0;
+
+static AppTimer *s_retry_timer = NULL;
+static uint8_t s_retries = 0;
+static uint32_t s_request_hash = 0;
+static uint32_t s_partial_hash = 0;
+static uint32_t s_partial_received = 0;
+
+/*
+ * True if we've already handled this message from the phone
+ */
+bool transport_is_duplicate(DictionaryIterator *iterator) {
+    Tuple *id_tuple = dict_find(iterator, MESSAGE_KEY_MSG_ID);
+    if (!id_tuple) {
+        return false;
+    }
+
+    uint32_t id = id_tuple->value->uint32;
+    if (s_have_last_id && id == s_last_id) {
+        LOG_WARNING("Dropping repeat of message %d", (int)id);
+        return true;
+    }
+    s_have_last_id = true;
+    s_last_id = id;
+    return false;
+}
+
+static void hash_string(uint32_t *hash, const char *text) {
+    for (const char *c = text; *c; c++) {
+        *hash = *hash * 33 + (uint8_t)*c;
+    }
+}
+
+/*
+ * djb2 over the title, a zero byte, then the poem, as bytes
+ * Must match contentHash in src/pkjs/transport.js
+ */
+uint32_t transport_hash(const char *title, const char *poem) {
+    uint32_t hash = 5381;
+    hash_string(&hash, title ? title : "");
+    hash = hash * 33;
+    hash_string(&hash, poem ? poem : "");
+    return hash;
+}
+
+static void retry_callback(void *data) {
+    s_retry_timer = NULL;
+    transport_request_poem(s_request_hash, s_partial_hash, s_partial_received);
+}
+
+static void schedule_retry(void) {
+    if (s_retries >= TRANSPORT_MAX_RETRIES) {
+        LOG_WARNING("Giving up on poem request after %d tries", (int)s_retries + 1);
+        s_retries = 0;
+        return;
+    }
+
+    uint32_t delay = TRANSPORT_RETRY_MS << s_retries;
+    s_retries++;
+    if (s_retry_timer) {
+        app_timer_cancel(s_retry_timer);
+    }
+    s_retry_timer = app_timer_register(delay, retry_callback, NULL);
+}
+
+/*
+ * Ask the phone for poems, telling it the hash of the one we have, retrying in the background if the outbox is busy
+ * or the message doesn't get through
+ * If we're part way through a poem, partial_hash is its POEM_HASH and received the bitmask of chunks we have, so the
+ * phone can send just the rest; otherwise partial_hash is 0
+ */
+void transport_request_poem(uint32_t hash, uint32_t partial_hash, uint32_t received) {
+    s_request_hash = hash;
+    s_partial_hash = partial_hash;
+    s_partial_received = received;
+
+    DictionaryIterator *iter;
+    if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+        schedule_retry();
+        return;
+    }
+    dict_write_uint8(iter, TRANSPORT_REQUEST_KEY, 0);
+    dict_write_uint32(iter, MESSAGE_KEY_POEM_HASH, hash);
+    if (partial_hash != 0) {
+        dict_write_uint32(iter, MESSAGE_KEY_POEM_RECEIVED_HASH, partial_hash);
+        dict_write_uint32(iter, MESSAGE_KEY_POEM_RECEIVED, received);
+    }
+    app_message_outbox_send();
+}
+
+void transport_outbox_sent(DictionaryIterator *iterator) {
+    if (dict_find(iterator, TRANSPORT_REQUEST_KEY)) {
+        s_retries = 0;
+    }
+}
+
+void transport_outbox_failed(DictionaryIterator *iterator, AppMessageResult reason) {
+    if (dict_find(iterator, TRANSPORT_REQUEST_KEY)) {
+        schedule_retry();
+    }
+}
+
+void transport_cancel(void) {
+    if (s_retry_timer) {
+        app_timer_cancel(s_retry_timer);
+        s_retry_timer = NULL;
+    }
+    s_retries = 0;
+}
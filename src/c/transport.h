@@ -0,0 +1,36 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Getting messages across a busy Bluetooth link without going back to the network
+ *
+ * Every message from the phone carries a MSG_ID one higher than the last. If
+ * the phone misses our ack it sends the message again with the same id, and
+ * we drop the repeat. Poem headers also carry POEM_HASH, a hash of the title
+ * and poem.
+ *
+ * Poem requests carry the POEM_HASH of the poem we're showing, so the phone
+ * can answer POEM_UNCHANGED instead of sending the same poem again. If the
+ * phone gave up part way through a poem, the next request also carries that
+ * poem's hash (POEM_RECEIVED_HASH) and a bitmask of the chunks we have
+ * (POEM_RECEIVED). The phone then sends the header again and only the missing
+ * chunks, and we carry on from the ones we kept (see sat-poems.c).
+ *
+ * Our poem requests are retried TRANSPORT_RETRY_MS after failing, doubling
+ * each time, up to TRANSPORT_MAX_RETRIES times; after that we wait for the
+ * next refresh.
+ */
+
+#define TRANSPORT_RETRY_MS 1000
+#define TRANSPORT_MAX_RETRIES 4
+
+// The phone treats any message it doesn't otherwise know as a poem request
+#define TRANSPORT_REQUEST_KEY 0
+
+bool transport_is_duplicate(DictionaryIterator *iterator);
+uint32_t transport_hash(const char *title, const char *poem);
+void transport_request_poem(uint32_t hash, uint32_t partial_hash, uint32_t received);
+void transport_outbox_sent(DictionaryIterator *iterator);
+void transport_outbox_failed(DictionaryIterator *iterator, AppMessageResult reason);
+void transport_cancel(void);
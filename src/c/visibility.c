@@ -0,0 +1,86 @@
+#include "visibility.h"
+#include "logging.h"
+
+static VisibilityHandler s_handler = NULL;
+static bool s_visible = true;
+static bool s_focused = true;
+static bool s_quiet = false;
+static time_t s_tap_until = 0; // shown after a tap during Quiet Time until then
+
+static void tap_handler(AccelAxisType axis, int32_t direction);
+
+/*
+ * Work out whether we're visible now, and tell the handler if that's changed
+ */
+static void update(void) {
+    bool quiet = quiet_time_is_active();
+    if (quiet != s_quiet) {
+        // Only listen for taps when they'd wake us, the accelerometer isn't free
+        s_quiet = quiet;
+        if (quiet) {
+            accel_tap_service_subscribe(tap_handler);
+        } else {
+            accel_tap_service_unsubscribe();
+        }
+    }
+
+    bool visible = s_focused && (!s_quiet || time(NULL) < s_tap_until);
+    if (visible == s_visible) {
+        return;
+    }
+
+    LOG_INFO("Visible: %d (focused %d, quiet %d)", (int)visible, (int)s_focused, (int)s_quiet);
+    s_visible = visible;
+    if (s_handler) {
+        s_handler(visible);
+    }
+}
+
+static void tap_handler(AccelAxisType axis, int32_t direction) {
+    s_tap_until = time(NULL) + VISIBILITY_TAP_MINUTES * 60;
+    update();
+}
+
+// Going out of focus pauses us straight away, coming back waits until we're on screen
+static void will_focus_handler(bool in_focus) {
+    if (!in_focus) {
+        s_focused = false;
+        update();
+    }
+}
+
+static void did_focus_handler(bool in_focus) {
+    if (in_focus) {
+        s_focused = true;
+        update();
+    }
+}
+
+void visibility_init(VisibilityHandler handler) {
+    s_handler = handler;
+    app_focus_service_subscribe_handlers((AppFocusHandlers) {
+        .will_focus = will_focus_handler,
+        .did_focus = did_focus_handler
+    });
+    update();
+}
+
+void visibility_deinit(void) {
+    app_focus_service_unsubscribe();
+    if (s_quiet) {
+        accel_tap_service_unsubscribe();
+        s_quiet = false;
+    }
+    s_handler = NULL;
+}
+
+bool visibility_is_visible(void) {
+    return s_visible;
+}
+
+/*
+ * Call every minute, to notice Quiet Time starting or ending and taps wearing off
+ */
+void visibility_tick(void) {
+    update();
+}
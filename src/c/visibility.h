@@ -0,0 +1,21 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Whether anyone is likely to be looking at the watchface
+ *
+ * We count as hidden while something else has focus, such as a notification
+ * on top of us, and while Quiet Time is on, which for most people means
+ * they're asleep. During Quiet Time a tap or flick of the wrist shows us
+ * again for VISIBILITY_TAP_MINUTES. The handler is called on every change.
+ */
+
+#define VISIBILITY_TAP_MINUTES 2
+
+typedef void (*VisibilityHandler)(bool visible);
+
+void visibility_init(VisibilityHandler handler);
+void visibility_deinit(void);
+bool visibility_is_visible(void);
+void visibility_tick(void);
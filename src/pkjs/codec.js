@@ -0,0 +1,122 @@
+// Compact encoding for poems on the wire; see src/c/poem-codec.h
+//
+// Common words and phrases are replaced by TOKEN followed by their index in
+// DICTIONARY. Everything else is sent as is.
+
+var TOKEN = 0x01;
+
+// Must match s_dictionary in src/c/poem-codec.c, in the same order
+var DICTIONARY = [
+    " the ",
+    " and ",
+    " of ",
+    " in ",
+    " at ",
+    " to ",
+    " is ",
+    "satellite",
+    "satellites",
+    "overhead",
+    " orbit",
+    " orbiting",
+    " above",
+    " passing",
+    " passes",
+    " over ",
+    " degrees",
+    " minutes",
+    " seconds",
+    " hours",
+    " kilometers",
+    " miles",
+    "altitude",
+    "azimuth",
+    "elevation",
+    "horizon",
+    " the sky",
+    "north",
+    "south",
+    "east",
+    "west",
+    "northeast",
+    "northwest",
+    "southeast",
+    "southwest",
+    "STARLINK",
+    "COSMOS",
+    "IRIDIUM",
+    "NOAA",
+    "GLOBALSTAR",
+    "ORBCOMM",
+    "FLOCK",
+    "LEMUR",
+    "ONEWEB",
+    " R/B",
+    " DEB",
+    "rocket body",
+    "debris",
+    "launched",
+    " by ",
+    " from ",
+    " with ",
+    "ing ",
+    "ed ",
+    "tion",
+    "\n\n",
+    ", ",
+    ". "
+];
+
+var dictionaryBytes = DICTIONARY.map(function(entry) {
+    var bytes = [];
+    for (var i = 0; i < entry.length; i++) {
+        bytes.push(entry.charCodeAt(i));
+    }
+    return bytes;
+});
+
+// Length of the dictionary entry matching bytes at pos, or 0
+function matchLength(bytes, pos, entry) {
+    if (pos + entry.length > bytes.length) {
+        return 0;
+    }
+    for (var i = 0; i < entry.length; i++) {
+        if (bytes[pos + i] !== entry[i]) {
+            return 0;
+        }
+    }
+    return entry.length;
+}
+
+// Encode an array of UTF-8 bytes, always taking the longest dictionary match
+// Returns null if encoding doesn't help, or the text can't be encoded
+function encode(bytes) {
+    if (bytes.indexOf(TOKEN) >= 0) {
+        return null;
+    }
+
+    var out = [];
+    var pos = 0;
+    while (pos < bytes.length) {
+        var best = -1;
+        var bestLength = 0;
+        for (var i = 0; i < dictionaryBytes.length; i++) {
+            var length = matchLength(bytes, pos, dictionaryBytes[i]);
+            if (length > bestLength) {
+                best = i;
+                bestLength = length;
+            }
+        }
+
+        if (best >= 0) {
+            out.push(TOKEN, best);
+            pos += bestLength;
+        } else {
+            out.push(bytes[pos++]);
+        }
+    }
+
+    return out.length < bytes.length ? out : null;
+}
+
+module.exports.encode = encode;
@@ -0,0 +1,150 @@
+// Fetching poems from the server without asking more often than the sky changes
+//
+// The watch pings us on every start and every refresh. Pings that arrive
+// while a fetch is under way wait for that fetch instead of starting another:
+// its poems are handled once, by the callback that started it, and the
+// others only hear when it's done.
+// The position is kept for LOCATION_MAX_AGE, and responses are kept for
+// RESPONSE_MAX_AGE under the place they were asked for: latitude and
+// longitude rounded to two places (about a kilometre) and the timezone
+// offset. Once a response is older than that we ask the server again,
+// sending its ETag so an unchanged answer costs a 304. Everything is kept in
+// localStorage, since we start afresh each time the watchface does.
+
+var POEM_URL = 'http://api.zeitkunst.org/sats/pebble/poem/';
+var LOCATION_MAX_AGE = 15 * 60 * 1000;
+var RESPONSE_MAX_AGE = 10 * 60 * 1000; // the watch's poemPeriod
+var RESPONSE_CACHE_SIZE = 4;
+var REQUEST_TIMEOUT = 20000;
+
+var inFlight = null; // {received, waiting} for the fetch under way, or null if there isn't one
+var stats = {requests: 0, coalesced: 0, hits: 0, misses: 0, notModified: 0, locationHits: 0, locationMisses: 0};
+
+function load(name, fallback) {
+    return JSON.parse(localStorage.getItem(name) || 'null') || fallback;
+}
+
+function finish(responseText, pos, offsetHours) {
+    var fetch = inFlight;
+    inFlight = null;
+    console.log("Poem fetches: " + JSON.stringify(stats));
+    fetch.received(responseText, pos, offsetHours);
+    fetch.waiting.forEach(function(done) {
+        done(responseText !== null);
+    });
+}
+
+// Last known position if it's recent enough, otherwise ask for one
+function getPosition(success, failure) {
+    var kept = load('position', null);
+    if (kept && Date.now() - kept.time < LOCATION_MAX_AGE) {
+        stats.locationHits++;
+        success({coords: {latitude: kept.latitude, longitude: kept.longitude}});
+        return;
+    }
+
+    stats.locationMisses++;
+    navigator.geolocation.getCurrentPosition(
+        function(pos) {
+            localStorage.setItem('position', JSON.stringify({
+                time: Date.now(), latitude: pos.coords.latitude, longitude: pos.coords.longitude}));
+            success(pos);
+        },
+        failure,
+        {timeout: 15000, maximumAge: LOCATION_MAX_AGE}
+    );
+}
+
+// GET url, sending the ETag of the response we kept for it. A 304 gets the
+// kept body; errors and timeouts get null.
+function conditionalRequest(url, kept, callback) {
+    var xhr = new XMLHttpRequest();
+    xhr.onload = function() {
+        if (this.status === 304 && kept) {
+            stats.notModified++;
+            callback(kept.body, kept.etag);
+        } else if (this.status >= 200 && this.status < 300) {
+            callback(this.responseText, this.getResponseHeader('ETag'));
+        } else {
+            console.log("Poem server answered " + this.status);
+            callback(null);
+        }
+    };
+    xhr.onerror = xhr.ontimeout = function() {
+        console.log("Couldn't reach the poem server");
+        callback(null);
+    };
+    xhr.open('GET', url);
+    xhr.timeout = REQUEST_TIMEOUT;
+    if (kept && kept.etag) {
+        xhr.setRequestHeader('If-None-Match', kept.etag);
+    }
+    xhr.send();
+}
+
+// Keep a response, dropping the oldest once there are more than RESPONSE_CACHE_SIZE
+function keep(responses, key, body, etag) {
+    responses[key] = {time: Date.now(), body: body, etag: etag};
+    var keys = Object.keys(responses).sort(function(a, b) {
+        return responses[b].time - responses[a].time;
+    });
+    keys.slice(RESPONSE_CACHE_SIZE).forEach(function(old) {
+        delete responses[old];
+    });
+    localStorage.setItem('poemResponses', JSON.stringify(responses));
+}
+
+// Get the poems for where we are now. received(responseText, pos, offsetHours)
+// gets a null responseText if there aren't any to be had. If a fetch is
+// already under way, received isn't called; done(gotPoems), if given, is
+// called either way once the fetch is over.
+function fetchPoems(received, done) {
+    stats.requests++;
+    if (inFlight) {
+        stats.coalesced++;
+        if (done) {
+            inFlight.waiting.push(done);
+        }
+        return;
+    }
+    inFlight = {received: received, waiting: done ? [done] : []};
+
+    getPosition(function(pos) {
+        // Give longitude in E longitude, coordinate change happens on the server
+        var offsetHours = new Date().getTimezoneOffset();
+        var place = pos.coords.latitude.toFixed(2) + "," + pos.coords.longitude.toFixed(2);
+        var key = place + "/" + offsetHours;
+
+        var responses = load('poemResponses', {});
+        var kept = responses[key];
+        if (kept && Date.now() - kept.time < RESPONSE_MAX_AGE) {
+            stats.hits++;
+            finish(kept.body, pos, offsetHours);
+            return;
+        }
+
+        stats.misses++;
+        conditionalRequest(POEM_URL + key, kept, function(body, etag) {
+            if (body !== null) {
+                keep(responses, key, body, etag);
+            }
+            finish(body, pos, offsetHours);
+        });
+    }, function(err) {
+        console.log("Error requesting location!");
+        finish(null, null, null);
+    });
+}
+
+// Where we were last time we asked, however long ago, or null if we've never known
+function lastPlace() {
+    var kept = load('position', null);
+    if (!kept) {
+        return null;
+    }
+    return {latitude: kept.latitude, longitude: kept.longitude, offsetHours: new Date().getTimezoneOffset()};
+}
+
+module.exports.fetchPoems = fetchPoems;
+module.exports.lastPlace = lastPlace;
+module.exports.stats = stats;
@@ -1,108 +1,456 @@
+var codec = require('./codec');
+var fetcher = require('./fetcher');
+var transport = require('./transport');
+
+// Errors, timeouts and anything but a 2xx get null
 var xhrRequest = function(url, type, callback) {
     var xhr = new XMLHttpRequest();
     xhr.onload = function() {
-        callback(this.responseText);
+        if (this.status >= 200 && this.status < 300) {
+            callback(this.responseText);
+        } else {
+            console.log(url + " answered " + this.status);
+            callback(null);
+        }
+    };
+    xhr.onerror = xhr.ontimeout = function() {
+        console.log("Couldn't reach " + url);
+        callback(null);
     };
     xhr.open(type, url);
+    xhr.timeout = 20000;
     xhr.send();
 };
 
+// Poems are sent in chunks so the watch can keep a small inbox
+// Must match POEM_CHUNK_SIZE in src/c/poem-chunks.h
+var POEM_CHUNK_SIZE = 200;
+var POEM_MAX_LENGTH = 4096;
 
-function locationSuccess(pos) {
-    var url = 'http://api.openweathermap.org/data/2.5/weather?lat=' +
-          pos.coords.latitude + '&lon=' + pos.coords.longitude + '&appid=' + 'c88a92d74ad04c28efeb18301300a838';
+// The watch keeps a ring of upcoming poems and switches between them itself
+// Must match POEM_CACHE_SLOTS in src/c/poem-cache.h
+var POEM_BATCH_SIZE = 3;
 
-    /*
-    // Send request to OpenWeatherMap
-    xhrRequest(url, 'GET',
-        function(responseText) {
-            // responseText contains a JSON object with weather info
-            var json = JSON.parse(responseText);
+// Convert a string into an array of UTF-8 bytes
+function utf8Bytes(str) {
+    var encoded = unescape(encodeURIComponent(str));
+    var bytes = [];
+    for (var i = 0; i < encoded.length; i++) {
+        bytes.push(encoded.charCodeAt(i));
+    }
+    return bytes;
+}
 
-            // Temp in Kelvin requires adjustment
-            var temperature = Math.round(json.main.temp - 273.15);
-            console.log('Temperature is ' + temperature);
+// Poems already fetched that didn't make it to the watch, sent again on its
+// next request rather than going back to the server
+var unsentEntries = [];
 
-            // Conditions
-            var conditions = json.weather[0].main;
-            console.log('Conditions are ' + conditions);
+// POEM_HASH of the poem the watch had when it last asked, as a signed 32 bit number
+var watchPoemHash = null;
 
-            // Assemble dictionary using our keys
-            var dictionary = {
-                "TEMPERATURE":temperature,
-                "CONDITIONS":conditions
-            };
+function entryHash(entry) {
+    return transport.contentHash(utf8Bytes(entry.title), utf8Bytes(entry.poem).slice(0, POEM_MAX_LENGTH)) | 0;
+}
 
-            // Send to Pebble
-            Pebble.sendAppMessage(dictionary,
-                function(e) {
-                    console.log("Weather info sent to Pebble successfully!");
-                },
-                function(e) {
-                    console.log("Error sending weather info to Pebble!");
-                }
-            );
+// Send a title and poem: first a header with the title, total length and
+// validity window, then each chunk in turn. The transport retries each
+// message; if one still fails we give up on the poem and call failed,
+// otherwise done once the last chunk has gone. Chunks whose bit is set in
+// received, which the watch already has, are skipped.
+function sendPoem(entry, done, failed, received) {
+    var bytes = utf8Bytes(entry.poem).slice(0, POEM_MAX_LENGTH);
+    var length = bytes.length;
+    var hash = transport.contentHash(utf8Bytes(entry.title), bytes);
+
+    // Send the compact encoding instead when it's smaller
+    var encoded = codec.encode(bytes);
+    if (encoded) {
+        console.log("Encoded poem from " + length + " to " + encoded.length + " bytes");
+        bytes = encoded;
+    }
+
+    var numChunks = Math.ceil(bytes.length / POEM_CHUNK_SIZE);
+
+    function sendChunk(seq) {
+        while (seq < numChunks && received & (1 << seq)) {
+            seq++;
+        }
+        if (seq >= numChunks) {
+            console.log("Poem sent to Pebble successfully!");
+            done();
+            return;
+        }
+
+        var chunk = bytes.slice(seq * POEM_CHUNK_SIZE, (seq + 1) * POEM_CHUNK_SIZE);
+        transport.send({"POEM_SEQ":seq, "POEM":chunk},
+            function(e) {
+                sendChunk(seq + 1);
+            },
+            function(e) {
+                console.log("Error sending poem chunk " + seq + " to Pebble: " + JSON.stringify(e));
+                failed();
+            }
+        );
+    }
+
+    // The hash lets the watch keep the chunks it has if we send the rest of this poem later
+    var header = {"TITLE":entry.title, "POEM_LENGTH":length, "POEM_LOCATION":entry.location, "POEM_HASH":hash | 0};
+    if (encoded) {
+        header["POEM_WIRE_LENGTH"] = bytes.length;
+    }
+    if (entry.start && entry.end) {
+        header["POEM_VALID_FROM"] = entry.start;
+        header["POEM_VALID_UNTIL"] = entry.end;
+    }
+
+    transport.send(header,
+        function(e) {
+            sendChunk(0);
+        },
+        function(e) {
+            console.log("Error sending poem to Pebble: " + JSON.stringify(e));
+            failed();
         }
     );
-    */
+}
 
-    //var satsURL = 'http://api.zeitkunst.org/sats/pebble/poem/42.294615,71.302342,185';
-    // Give longitude in E longitude, coordinate change happens on the server
-    var offsetHours = new Date().getTimezoneOffset();
-    var satsURL = 'http://api.zeitkunst.org/sats/pebble/poem/' + pos.coords.latitude + "," + pos.coords.longitude + "/" + offsetHours;
+// Send a batch of poems one after the other. Whatever doesn't get through is
+// kept in unsentEntries for the next time the watch asks. partial, if given,
+// is {hash, received} for a poem the watch has some chunks of.
+function sendPoems(entries, partial) {
+    var next = 0;
+    unsentEntries = [];
 
-    // Send request to OpenWeatherMap
-    xhrRequest(satsURL, 'GET',
-        function(responseText) {
-            // responseText contains a JSON object with weather info
-            var sats = JSON.parse(responseText);
+    function sendNext() {
+        if (next < entries.length) {
+            var entry = entries[next];
+            var received = partial && entryHash(entry) === partial.hash ? partial.received : 0;
+            sendPoem(entry, function() {
+                next++;
+                sendNext();
+            }, function() {
+                unsentEntries = entries.slice(next);
+            }, received);
+        }
+    }
+    sendNext();
+}
+
+// Orbital elements so the watch can predict passes itself when we can't
+// reach the poem server. They only need refreshing about once a day.
+// Must match SAT_PREDICT_MAX_SATS and SatElements in src/c/sat-predict.h
+var ELEMENTS_URL = 'https://celestrak.org/NORAD/elements/gp.php?GROUP=visual&FORMAT=json';
+var ELEMENTS_MAX_AGE = 24 * 60 * 60 * 1000;
+var SAT_PREDICT_MAX_SATS = 8;
+var SAT_ELEMENTS_SIZE = 32;
+
+function packUint(bytes, offset, value, size) {
+    for (var i = 0; i < size; i++) {
+        bytes[offset + i] = Math.floor(value / Math.pow(256, i)) & 0xFF;
+    }
+}
+
+// Angle in degrees to TRIG_MAX_ANGLE units
+function packAngle(bytes, offset, degrees) {
+    packUint(bytes, offset, Math.round((((degrees % 360) + 360) % 360) / 360 * 65536) & 0xFFFF, 2);
+}
 
-            console.log("Lat, long: " + pos.coords.latitude + ", " + pos.coords.longitude);
-            console.log(sats["title"]);
-            console.log(sats["poem"]);
+function packElements(sats) {
+    var bytes = [];
+    sats.forEach(function(sat, n) {
+        var offset = n * SAT_ELEMENTS_SIZE;
+        for (var i = 0; i < SAT_ELEMENTS_SIZE; i++) {
+            bytes[offset + i] = 0;
+        }
+        var name = sat["OBJECT_NAME"].substring(0, 12);
+        for (var j = 0; j < name.length; j++) {
+            bytes[offset + j] = name.charCodeAt(j) & 0x7F;
+        }
+        packUint(bytes, offset + 12, Math.round(Date.parse(sat["EPOCH"] + "Z") / 1000), 4);
+        packUint(bytes, offset + 16, Math.round(sat["MEAN_MOTION"] * 1e6), 4);
+        packAngle(bytes, offset + 20, sat["INCLINATION"]);
+        packAngle(bytes, offset + 22, sat["RA_OF_ASC_NODE"]);
+        packUint(bytes, offset + 24, Math.min(Math.round(sat["ECCENTRICITY"] * 65536), 0xFFFF), 2);
+        packAngle(bytes, offset + 26, sat["ARG_OF_PERICENTER"]);
+        packAngle(bytes, offset + 28, sat["MEAN_ANOMALY"]);
+    });
+    return bytes;
+}
 
+function sendElements(pos) {
+    var fetched = parseInt(localStorage.getItem('elementsFetched') || '0', 10);
+    if (Date.now() - fetched < ELEMENTS_MAX_AGE) {
+        return;
+    }
 
-            // Assemble dictionary using our keys
+    xhrRequest(ELEMENTS_URL, 'GET',
+        function(responseText) {
+            if (responseText === null) {
+                return;
+            }
+            var sats, elements;
+            try {
+                sats = JSON.parse(responseText).slice(0, SAT_PREDICT_MAX_SATS);
+                elements = packElements(sats);
+            } catch (e) {
+                console.log("Couldn't read satellite elements: " + e.message);
+                return;
+            }
             var dictionary = {
-                "TITLE":sats["title"],
-                "POEM":sats["poem"]
+                "SAT_ELEMENTS":elements,
+                "OBSERVER_LAT":Math.round(pos.coords.latitude * 10000),
+                "OBSERVER_LON":Math.round(pos.coords.longitude * 10000)
             };
 
-            // Send to Pebble
-            Pebble.sendAppMessage(dictionary,
+            transport.send(dictionary,
                 function(e) {
-                    console.log("Poem sent to Pebble successfully!");
+                    console.log("Elements for " + sats.length + " satellites sent to Pebble");
+                    localStorage.setItem('elementsFetched', String(Date.now()));
                 },
                 function(e) {
-                    console.log("Error sending poem to Pebble: " + JSON.stringify(e));
+                    console.log("Error sending elements to Pebble: " + JSON.stringify(e));
                 }
             );
+        }
+    );
+}
 
+// Small hash of where a poem was written for, so the watch can tell cached
+// poems for different places apart
+function locationHash(lat, lon, offsetHours) {
+    var key = lat.toFixed(2) + "," + lon.toFixed(2) + "/" + offsetHours;
+    var hash = 5381;
+    for (var i = 0; i < key.length; i++) {
+        hash = ((hash * 33) + key.charCodeAt(i)) | 0;
+    }
+    return hash;
+}
 
+function poemsReceived(responseText, pos, offsetHours) {
+    // Independent of the poem server, so the watch can manage without it
+    if (pos) {
+        sendElements(pos);
+    }
+    if (responseText === null) {
+        return;
+    }
+
+    var sats = JSON.parse(responseText);
+
+    console.log("Lat, long: " + pos.coords.latitude + ", " + pos.coords.longitude);
+    var location = locationHash(pos.coords.latitude, pos.coords.longitude, offsetHours);
+
+    // A batch of upcoming passes comes back as "poems", each with a
+    // start and end time (seconds since the epoch); a single poem has
+    // no window and is good until the watch's next refresh
+    var entries = [];
+    if (sats["poems"]) {
+        entries = sats["poems"].slice(0, POEM_BATCH_SIZE).map(function(p) {
+            return {title:p["title"], poem:p["poem"], location:location, start:p["start"], end:p["end"]};
+        });
+    } else {
+        console.log(sats["title"]);
+        console.log(sats["poem"]);
+        entries.push({title:sats["title"], poem:sats["poem"], location:location});
+    }
+
+    // Nothing new for the watch, so save it the poem and the relayout
+    if (entries.length === 1 && entryHash(entries[0]) === watchPoemHash) {
+        transport.send({"POEM_UNCHANGED":1},
+            function(e) {
+                console.log("Told Pebble its poem is unchanged");
+            },
+            function(e) {
+                console.log("Error telling Pebble its poem is unchanged: " + JSON.stringify(e));
+            }
+        );
+        return;
+    }
+
+    // Send to Pebble
+    sendPoems(entries);
+}
+
+// Despite the name, fetches poems; see src/pkjs/fetcher.js
+function getWeather() {
+    fetcher.fetchPoems(poemsReceived);
+}
+
+// Presentation timeline for the watch, see src/c/timeline.h. Leave null for
+// the watch's own; an empty array tells the watch to go back to its own.
+// Each step is {duration (ms), enter, exit, repeat, next, optional}, with
+// actions named as in TimelineActionId in src/c/sat-poems.c. For example,
+// skipping the title and lingering on each page:
+//   [{duration: 2000, next: 1},
+//    {duration: 8000, enter: "SHOW_POEM", exit: "HIDE_POEM", repeat: "NEXT_PAGE", next: 0}]
+var CUSTOM_TIMELINE = null;
+var TIMELINE_ACTIONS = [null, "SHOW_TITLE", "HIDE_TITLE", "SHOW_POEM", "HIDE_POEM", "NEXT_PAGE"];
+var TIMELINE_MAX_STEPS = 16;
+var TIMELINE_OPTIONAL = 1;
+
+function timelineAction(name) {
+    var action = TIMELINE_ACTIONS.indexOf(name || null);
+    if (action < 0) {
+        throw new Error("unknown timeline action " + JSON.stringify(name));
+    }
+    return action;
+}
+
+// Packed TimelineSteps, 8 bytes each; throws on an action the watch doesn't have
+function packTimeline(steps) {
+    var bytes = [];
+    steps.slice(0, TIMELINE_MAX_STEPS).forEach(function(step, n) {
+        var offset = n * 8;
+        packUint(bytes, offset, step.duration, 2);
+        bytes[offset + 2] = timelineAction(step.enter);
+        bytes[offset + 3] = timelineAction(step.exit);
+        bytes[offset + 4] = timelineAction(step.repeat);
+        bytes[offset + 5] = step.next || 0;
+        bytes[offset + 6] = step.optional ? TIMELINE_OPTIONAL : 0;
+        bytes[offset + 7] = 0;
+    });
+    return bytes;
+}
+
+function sendTimeline(steps) {
+    var packed;
+    try {
+        packed = packTimeline(steps);
+    } catch (e) {
+        console.log("Not sending timeline to Pebble: " + e.message);
+        return;
+    }
+    transport.send({"TIMELINE":packed},
+        function(e) {
+            console.log("Timeline of " + steps.length + " steps sent to Pebble");
+        },
+        function(e) {
+            console.log("Error sending timeline to Pebble: " + JSON.stringify(e));
         }
     );
+}
 
+// Trace events dumped from the watch, see src/c/trace.h
+// Set to true to ask for a dump every time the watchface starts
+var TRACE_ON_READY = false;
+var TRACE_EVENT_NAMES = [null, "STATE_ENTER", "STATE_TIMER", "PAGE", "TICK", "POEM_REQUEST",
+    "POEM_CHUNK", "POEM_SET", "INBOX_DROPPED", "OUTBOX_FAILED", "PAGE_TRANSITION",
+    "POWER_LEVEL", "VISIBILITY", "POEM_UNCHANGED", "INBOX"];
+var traceEvents = [];
+var traceBytes = [];
+
+function hexBytes(bytes) {
+    return bytes.map(function(b) {
+        return (b < 16 ? "0" : "") + b.toString(16);
+    }).join("");
 }
 
-function locationError(err) {
-    console.log("Error requesting location!");
+// Each event is 8 bytes: uint32 time in ms, uint8 id, a spare byte, uint16 arg
+function receiveTrace(bytes) {
+    traceBytes = traceBytes.concat(bytes);
+    for (var offset = 0; offset + 8 <= bytes.length; offset += 8) {
+        traceEvents.push({
+            time: bytes[offset] + bytes[offset + 1] * 256 + bytes[offset + 2] * 65536 + bytes[offset + 3] * 16777216,
+            id: bytes[offset + 4],
+            arg: bytes[offset + 6] + bytes[offset + 7] * 256
+        });
+    }
 }
 
-function getWeather() {
-    navigator.geolocation.getCurrentPosition(
-        locationSuccess,
-        locationError,
-        {timeout: 15000, maximumAge: 60000}
+function logTrace() {
+    var start = traceEvents.length > 0 ? traceEvents[0].time : 0;
+    traceEvents.forEach(function(event) {
+        console.log("trace +" + (event.time - start) + "ms " +
+            (TRACE_EVENT_NAMES[event.id] || event.id) + " " + event.arg);
+    });
+    traceEvents = [];
+
+    // The raw dump on one line, for scripts/trace-report.py to pick out of `pebble logs`
+    console.log("trace-record " + hexBytes(traceBytes));
+    traceBytes = [];
+}
+
+function requestTrace() {
+    traceEvents = [];
+    traceBytes = [];
+    transport.send({"TRACE_DUMP":1},
+        function(e) {},
+        function(e) {
+            console.log("Error asking Pebble for a trace: " + JSON.stringify(e));
+        }
     );
 }
 
+// Hourly heap and timing reports from the watch, see src/c/diagnostics.h
+var DIAGNOSTICS_TIMERS = ["poem layout", "page draw", "window load", "page transition"];
+var diagnosticsTotals = {reports: 0, heapUsedMax: 0, heapFreeMin: null, timers: []};
+
+function readUint(bytes, offset, size) {
+    var value = 0;
+    for (var i = size - 1; i >= 0; i--) {
+        value = value * 256 + bytes[offset + i];
+    }
+    return value;
+}
+
+// Report is uint32 heap used high-water, uint32 heap free low-water, then
+// uint16 count, uint16 max ms and uint32 total ms for each timer
+function receiveDiagnostics(bytes) {
+    var heapUsedMax = readUint(bytes, 0, 4);
+    var heapFreeMin = readUint(bytes, 4, 4);
+    console.log("diagnostics: heap used max " + heapUsedMax + ", free min " + heapFreeMin);
+
+    diagnosticsTotals.reports++;
+    diagnosticsTotals.heapUsedMax = Math.max(diagnosticsTotals.heapUsedMax, heapUsedMax);
+    if (heapFreeMin > 0 && (diagnosticsTotals.heapFreeMin === null || heapFreeMin < diagnosticsTotals.heapFreeMin)) {
+        diagnosticsTotals.heapFreeMin = heapFreeMin;
+    }
+
+    DIAGNOSTICS_TIMERS.forEach(function(name, i) {
+        var offset = 8 + i * 8;
+        var count = readUint(bytes, offset, 2);
+        var maxMs = readUint(bytes, offset + 2, 2);
+        var totalMs = readUint(bytes, offset + 4, 4);
+        var totals = diagnosticsTotals.timers[i] || {count: 0, maxMs: 0, totalMs: 0};
+
+        totals.count += count;
+        totals.maxMs = Math.max(totals.maxMs, maxMs);
+        totals.totalMs += totalMs;
+        diagnosticsTotals.timers[i] = totals;
+
+        if (count > 0) {
+            console.log("diagnostics: " + name + " x" + count + ", max " + maxMs + "ms, mean " +
+                Math.round(totalMs / count) + "ms (overall max " + totals.maxMs + "ms over " + totals.count + ")");
+        }
+    });
+}
+
 // Listen for when the watchface is opened
 Pebble.addEventListener('ready',
     function(e) {
         console.log('PebbleKit JS ready!');
 
-        // Get the initial weather
-        getWeather();
+        // Let the watch know we're here, and where we last were so it can drop
+        // poems cached for anywhere else; it asks for a poem if its cached one is stale
+        var ready = {"READY":1};
+        var place = fetcher.lastPlace();
+        if (place) {
+            ready["POEM_LOCATION"] = locationHash(place.latitude, place.longitude, place.offsetHours);
+        }
+        transport.send(ready,
+            function(e) {
+                if (TRACE_ON_READY) {
+                    requestTrace();
+                }
+                if (CUSTOM_TIMELINE) {
+                    sendTimeline(CUSTOM_TIMELINE);
+                }
+            },
+            function(e) {
+                console.log("Error telling Pebble we're ready, fetching anyway");
+                getWeather();
+            }
+        );
     }
 );
 
@@ -110,7 +458,32 @@ Pebble.addEventListener('ready',
 Pebble.addEventListener('appmessage',
     function(e) {
         console.log('AppMessage received!');
-        getWeather();
+
+        if (e.payload["TRACE"] !== undefined) {
+            receiveTrace(e.payload["TRACE"]);
+        } else if (e.payload["TRACE_DUMP"] !== undefined) {
+            logTrace();
+        } else if (e.payload["DIAGNOSTICS"] !== undefined) {
+            receiveDiagnostics(e.payload["DIAGNOSTICS"]);
+        } else {
+            // A poem request, with the hash of the poem the watch has
+            if (e.payload["POEM_HASH"] !== undefined) {
+                watchPoemHash = e.payload["POEM_HASH"] | 0;
+            }
+
+            if (unsentEntries.length > 0) {
+                // We already have poems the watch didn't get, no need for the network,
+                // and it may have part of the first of them already
+                var partial = null;
+                if (e.payload["POEM_RECEIVED_HASH"] !== undefined) {
+                    partial = {hash: e.payload["POEM_RECEIVED_HASH"] | 0, received: e.payload["POEM_RECEIVED"] | 0};
+                }
+                console.log("Sending " + unsentEntries.length + " unsent poems again");
+                sendPoems(unsentEntries, partial);
+            } else {
+                getWeather();
+            }
+        }
     }
 );
 
@@ -0,0 +1,91 @@
+// Outgoing AppMessages; see src/c/transport.h
+//
+// Messages go one at a time, in order. Each carries a MSG_ID so the watch can
+// drop a repeat when its ack went missing, and a failed send is tried again
+// after RETRY_BASE_MS, doubling each time, up to MAX_RETRIES times. A message
+// identical to one still waiting to go is not queued a second time.
+
+var RETRY_BASE_MS = 250;
+var MAX_RETRIES = 5;
+
+var queue = [];
+var busy = false;
+var nextId = Date.now() % 0x7FFFFFFF;
+
+// djb2 over the UTF-8 bytes of the title, a zero byte, then the poem
+// Must match transport_hash in src/c/transport.c
+function contentHash(titleBytes, poemBytes) {
+    var hash = 5381;
+    titleBytes.concat([0], poemBytes).forEach(function(b) {
+        hash = ((hash * 33) + b) >>> 0;
+    });
+    return hash;
+}
+
+function finish(message, succeeded, e) {
+    queue.shift();
+    busy = false;
+    message.callbacks.forEach(function(callbacks) {
+        var callback = succeeded ? callbacks.success : callbacks.failure;
+        if (callback) {
+            callback(e);
+        }
+    });
+    pump();
+}
+
+function pump() {
+    if (busy || queue.length === 0) {
+        return;
+    }
+
+    var message = queue[0];
+    busy = true;
+    Pebble.sendAppMessage(message.dict,
+        function(e) {
+            finish(message, true, e);
+        },
+        function(e) {
+            if (message.attempts >= MAX_RETRIES) {
+                console.log("Giving up on message " + message.dict["MSG_ID"] + ": " + JSON.stringify(e));
+                finish(message, false, e);
+                return;
+            }
+
+            // Stay busy while we wait, so nothing jumps the queue
+            var delay = RETRY_BASE_MS * Math.pow(2, message.attempts);
+            message.attempts++;
+            setTimeout(function() {
+                busy = false;
+                pump();
+            }, delay);
+        }
+    );
+}
+
+// Queue a message, like Pebble.sendAppMessage. success or failure is called
+// once, after the last try.
+function send(dict, success, failure) {
+    var key = JSON.stringify(dict);
+    var callbacks = {success: success, failure: failure};
+
+    for (var i = 0; i < queue.length; i++) {
+        if (queue[i].key === key) {
+            queue[i].callbacks.push(callbacks);
+            return;
+        }
+    }
+
+    var message = {key: key, dict: {}, callbacks: [callbacks], attempts: 0};
+    for (var name in dict) {
+        message.dict[name] = dict[name];
+    }
+    message.dict["MSG_ID"] = nextId;
+    nextId = (nextId + 1) % 0x7FFFFFFF;
+
+    queue.push(message);
+    pump();
+}
+
+module.exports.contentHash = contentHash;
+module.exports.send = send;
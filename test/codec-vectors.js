@@ -0,0 +1,48 @@
+// Encodes a small corpus of poems with src/pkjs/codec.js into a C header, so
+// test-poem-codec.c can check the watch decodes exactly what the phone sends.
+// Run by the Makefile: node codec-vectors.js > build/codec-vectors.h
+
+var codec = require('../src/pkjs/codec.js');
+
+var CORPUS = [
+    "STARLINK-1130 passes overhead at 21:14,\nclimbs to 62 degrees above the horizon\nand sets in the southeast.",
+    "In the sky tonight the satellites are passing over the city:\n\n" +
+        "ISS (ZARYA) rises in the northwest at 20:41, climbs to 48 degrees, and sets in the southeast at 20:47.\n\n" +
+        "COSMOS 2251 DEB, launched in 1993, orbiting at an altitude of 790 kilometers.\n\n" +
+        "NOAA 19 passes from north to south with the elevation of a bird in the evening.",
+    "IRIDIUM 33 DEB\nGLOBALSTAR M087\nORBCOMM FM107\nFLOCK 4P-2\nLEMUR-2-JOEL\nONEWEB-0012\nCZ-4C R/B",
+    "A rocket body tumbling, debris of the collision, in the minutes and seconds and hours of the orbit.",
+    "Nothing passes high overhead\nin the next 6 hours.\n\nThe sky keeps its own counsel.",
+    "“We are made of star stuff,” she said — and the satellite went by.",
+    "short",
+    ""
+];
+
+function cBytes(bytes) {
+    return '"' + bytes.map(function(b) {
+        return '\\x' + (b < 16 ? '0' : '') + b.toString(16);
+    }).join('') + '"';
+}
+
+var lines = [
+    '// Generated by test/codec-vectors.js from src/pkjs/codec.js; do not edit',
+    '',
+    'typedef struct {',
+    '    const char *plain;',
+    '    uint16_t length;',
+    '    const char *wire; // NULL if the phone would send the plain text',
+    '    uint16_t wire_length;',
+    '} CodecVector;',
+    '',
+    'static const CodecVector s_codec_vectors[] = {'
+];
+
+CORPUS.forEach(function(poem) {
+    var bytes = Array.prototype.slice.call(Buffer.from(poem, 'utf8'));
+    var encoded = codec.encode(bytes);
+    lines.push('    { ' + cBytes(bytes) + ', ' + bytes.length + ', ' +
+        (encoded ? cBytes(encoded) + ', ' + encoded.length : 'NULL, 0') + ' },');
+});
+
+lines.push('};', '');
+console.log(lines.join('\n'));
@@ -0,0 +1,1012 @@
+#include "fake-pebble.h"
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The real ones, from here on
+#undef time
+#undef malloc
+#undef free
+#undef memcpy
+
+#define FAKE_PERSIST_KEYS 64
+#define FAKE_MAX_TIMERS 64
+#define FAKE_MAX_LAYERS 32
+#define FAKE_MAX_TUPLES 16
+#define FAKE_INBOX_QUEUE 16
+#define FAKE_DRAWN_LENGTH 128
+#define FAKE_CHAR_WIDTH 10 // every character is this wide, in pixels
+#define FAKE_LINE_HEIGHT 28
+
+int sat_poems_main(void); // sat-poems.c's main, renamed by the Makefile
+
+int test_failures = 0;
+
+/*
+ * Everything that outlives a fake_run child lives in shared memory
+ */
+typedef struct {
+    uint32_t key;
+    uint16_t length;
+    bool used;
+    uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} FakePersistKey;
+
+typedef struct {
+    uint64_t now_ms;
+    FakeStats stats;
+    FakePersistKey persist[FAKE_PERSIST_KEYS];
+    int persist_fail_after;
+    BatteryChargeState battery;
+    bool quiet;
+    char drawn[FAKE_MAX_DRAWN][FAKE_DRAWN_LENGTH];
+    uint8_t next_drawn;
+} FakeWorld;
+
+static FakeWorld *s_world;
+
+/*
+ * Everything else belongs to one run of the app
+ */
+struct AppTimer {
+    uint64_t due;
+    uint32_t order; // registration order, to break ties
+    AppTimerCallback callback;
+    void *data;
+    bool active;
+};
+
+struct Layer {
+    GRect frame;
+    LayerUpdateProc update_proc;
+    Layer *parent;
+    TextLayer *text_layer; // set if this is a text layer's own layer
+    Window *root_of; // set if this is a window's root layer
+};
+
+struct TextLayer {
+    Layer layer;
+    const char *text;
+};
+
+struct Window {
+    WindowHandlers handlers;
+    Layer *root;
+    bool loaded;
+};
+
+struct DictionaryIterator {
+    Tuple *tuples[FAKE_MAX_TUPLES];
+    uint8_t count;
+    uint32_t capacity; // 0 for no limit
+};
+
+struct FontInfo {
+    uint32_t resource_id;
+};
+
+struct GContext {
+    GColor text_color;
+};
+
+typedef enum { OUTBOX_IDLE, OUTBOX_WRITING, OUTBOX_SENDING } OutboxState;
+
+static struct AppTimer s_timers[FAKE_MAX_TIMERS];
+static uint32_t s_timer_order;
+static Layer *s_layers[FAKE_MAX_LAYERS];
+static Window *s_window;
+static bool s_dirty;
+static TickHandler s_tick_handler;
+static BatteryStateHandler s_battery_handler;
+static AppFocusHandlers s_focus_handlers;
+static AccelTapHandler s_tap_handler;
+static void (*s_scenario)(void);
+
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageInboxDropped s_inbox_dropped;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+static uint32_t s_inbox_size, s_outbox_size;
+static DictionaryIterator s_outbox;
+static OutboxState s_outbox_state;
+static uint8_t s_outbox_failures;
+static DictionaryIterator *s_inbox[FAKE_INBOX_QUEUE];
+static uint8_t s_inbox_count;
+static FakePhone s_phone;
+static bool s_settling;
+
+static void dict_clear(DictionaryIterator *dict) {
+    for (uint8_t i = 0; i < dict->count; i++) {
+        free(dict->tuples[i]);
+    }
+    dict->count = 0;
+}
+
+static void reset_process(void) {
+    memset(s_timers, 0, sizeof(s_timers));
+    s_timer_order = 0;
+    memset(s_layers, 0, sizeof(s_layers));
+    s_window = NULL;
+    s_dirty = false;
+    s_tick_handler = NULL;
+    s_battery_handler = NULL;
+    memset(&s_focus_handlers, 0, sizeof(s_focus_handlers));
+    s_tap_handler = NULL;
+    s_inbox_received = NULL;
+    s_inbox_dropped = NULL;
+    s_outbox_sent = NULL;
+    s_outbox_failed = NULL;
+    s_inbox_size = s_outbox_size = 0;
+    dict_clear(&s_outbox);
+    s_outbox_state = OUTBOX_IDLE;
+    s_outbox_failures = 0;
+    while (s_inbox_count > 0) {
+        fake_dict_free(s_inbox[--s_inbox_count]);
+    }
+    s_phone = NULL;
+    s_settling = false;
+}
+
+/*
+ * Test controls
+ */
+void fake_reset(void) {
+    if (!s_world) {
+        s_world = mmap(NULL, sizeof(FakeWorld), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (s_world == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        // Ticks and the app's localtime() both in UTC
+        setenv("TZ", "UTC", 1);
+        tzset();
+    }
+
+    size_t heap_used = s_world->stats.heap_used;
+    memset(s_world, 0, sizeof(FakeWorld));
+    s_world->now_ms = (uint64_t)FAKE_START_TIME * 1000;
+    s_world->stats.heap_used = heap_used;
+    s_world->persist_fail_after = -1;
+    s_world->battery = (BatteryChargeState) { .charge_percent = 100 };
+    reset_process();
+}
+
+FakeStats *fake_stats(void) {
+    return &s_world->stats;
+}
+
+/*
+ * Zero the counters, keeping what describes the present: memory in use, and storage
+ */
+void fake_reset_stats(void) {
+    FakeStats *stats = &s_world->stats;
+    FakeStats kept = *stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->heap_used = stats->heap_peak = kept.heap_used;
+    stats->layers_alive = kept.layers_alive;
+    stats->fonts_loaded = kept.fonts_loaded;
+    stats->timers_active = kept.timers_active;
+    stats->persist_bytes = kept.persist_bytes;
+    stats->persist_keys = kept.persist_keys;
+}
+
+int fake_run(void (*scenario)(void)) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        reset_process();
+        test_failures = 0;
+        s_scenario = scenario;
+        sat_poems_main();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(test_failures > 255 ? 255 : test_failures);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    int failures;
+    if (WIFEXITED(status)) {
+        failures = WEXITSTATUS(status);
+    } else {
+        fprintf(stderr, "watchface died with signal %d\n", WTERMSIG(status));
+        failures = 1;
+    }
+    test_failures += failures;
+    return failures;
+}
+
+uint64_t fake_now_ms(void) {
+    return s_world->now_ms;
+}
+
+static void record_drawn(const char *text) {
+    snprintf(s_world->drawn[s_world->next_drawn], FAKE_DRAWN_LENGTH, "%s", text ? text : "");
+    s_world->next_drawn = (s_world->next_drawn + 1) % FAKE_MAX_DRAWN;
+}
+
+bool fake_drawn(const char *text) {
+    for (int i = 0; i < FAKE_MAX_DRAWN; i++) {
+        if (s_world->drawn[i][0] && strcmp(s_world->drawn[i], text) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void fake_clear_drawn(void) {
+    memset(s_world->drawn, 0, sizeof(s_world->drawn));
+    s_world->next_drawn = 0;
+}
+
+static bool on_screen(const Layer *layer) {
+    while (layer->parent) {
+        layer = layer->parent;
+    }
+    return layer->root_of && layer->root_of->loaded;
+}
+
+bool fake_text_shown(const char *text) {
+    for (int i = 0; i < FAKE_MAX_LAYERS; i++) {
+        Layer *layer = s_layers[i];
+        if (layer && layer->text_layer && on_screen(layer) &&
+                layer->text_layer->text && strstr(layer->text_layer->text, text)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Redraw the window, as the system would after an event that dirtied anything
+ */
+static void render(void) {
+    if (!s_dirty || !s_window || !s_window->loaded) {
+        return;
+    }
+    s_dirty = false;
+    s_world->stats.redraws++;
+
+    GContext ctx = { GColorWhite };
+    for (int i = 0; i < FAKE_MAX_LAYERS; i++) {
+        Layer *layer = s_layers[i];
+        if (!layer || !on_screen(layer)) {
+            continue;
+        }
+        if (layer->text_layer) {
+            record_drawn(layer->text_layer->text);
+            s_world->stats.text_draws++;
+        } else if (layer->update_proc) {
+            layer->update_proc(layer, &ctx);
+        }
+    }
+}
+
+static void deliver_outbox(void) {
+    DictionaryIterator in_flight = s_outbox;
+    s_outbox.count = 0;
+    s_outbox_state = OUTBOX_IDLE;
+    s_world->stats.wakeups++;
+
+    if (s_outbox_failures > 0) {
+        s_outbox_failures--;
+        s_world->stats.sends_failed++;
+        if (s_outbox_failed) {
+            s_outbox_failed(&in_flight, APP_MSG_SEND_TIMEOUT, NULL);
+        }
+    } else {
+        s_world->stats.messages_sent++;
+        if (s_phone) {
+            s_phone(&in_flight);
+        }
+        if (s_outbox_sent) {
+            s_outbox_sent(&in_flight, NULL);
+        }
+    }
+    dict_clear(&in_flight);
+}
+
+static void deliver_inbox(void) {
+    DictionaryIterator *dict = s_inbox[0];
+    s_inbox_count--;
+    memmove(s_inbox, s_inbox + 1, s_inbox_count * sizeof(s_inbox[0]));
+
+    uint32_t size = dict_size(dict);
+    s_world->stats.messages_received++;
+    s_world->stats.bytes_received += size;
+    s_world->stats.wakeups++;
+
+    if (s_inbox_size == 0) {
+        // Not listening yet, the system drops it
+    } else if (size > s_inbox_size) {
+        if (s_inbox_dropped) {
+            s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+        }
+    } else if (s_inbox_received) {
+        s_inbox_received(dict, NULL);
+    }
+    fake_dict_free(dict);
+}
+
+/*
+ * Deliver whatever messages are waiting in either direction, then redraw
+ */
+static void settle(void) {
+    if (s_settling) {
+        return;
+    }
+    s_settling = true;
+    for (int round = 0; round < 1000; round++) {
+        if (s_outbox_state == OUTBOX_SENDING) {
+            deliver_outbox();
+        } else if (s_inbox_count > 0) {
+            deliver_inbox();
+        } else {
+            break;
+        }
+    }
+    s_settling = false;
+    render();
+}
+
+static struct AppTimer *next_timer(void) {
+    struct AppTimer *next = NULL;
+    for (int i = 0; i < FAKE_MAX_TIMERS; i++) {
+        struct AppTimer *timer = &s_timers[i];
+        if (timer->active && (!next || timer->due < next->due ||
+                (timer->due == next->due && timer->order < next->order))) {
+            next = timer;
+        }
+    }
+    return next;
+}
+
+static void fire_tick(void) {
+    time_t now = (time_t)(s_world->now_ms / 1000);
+    struct tm tick_time;
+    gmtime_r(&now, &tick_time);
+
+    TimeUnits units = MINUTE_UNIT;
+    if (tick_time.tm_min == 0) {
+        units |= HOUR_UNIT;
+        if (tick_time.tm_hour == 0) {
+            units |= DAY_UNIT;
+        }
+    }
+    s_world->stats.ticks++;
+    s_world->stats.wakeups++;
+    s_tick_handler(&tick_time, units);
+}
+
+void fake_advance(uint64_t ms) {
+    uint64_t target = s_world->now_ms + ms;
+
+    while (true) {
+        struct AppTimer *timer = next_timer();
+        uint64_t tick = s_tick_handler ? (s_world->now_ms / 60000 + 1) * 60000 : UINT64_MAX;
+        // A tick due at the same time as a timer goes first, and the timer straight after
+        bool timer_first = timer && timer->due < tick;
+        uint64_t when = timer_first ? timer->due : tick;
+        if (when > target) {
+            break;
+        }
+        s_world->now_ms = when;
+
+        if (timer_first) {
+            AppTimerCallback callback = timer->callback;
+            void *data = timer->data;
+            timer->active = false;
+            s_world->stats.timers_active--;
+            s_world->stats.wakeups++;
+            callback(data);
+        } else {
+            fire_tick();
+        }
+        settle();
+    }
+    s_world->now_ms = target;
+}
+
+DictionaryIterator *fake_dict_create(void) {
+    return calloc(1, sizeof(DictionaryIterator));
+}
+
+static DictionaryResult dict_add(DictionaryIterator *dict, uint32_t key, TupleType type, const void *value, uint16_t length) {
+    if (dict->count >= FAKE_MAX_TUPLES) {
+        return DICT_NOT_ENOUGH_STORAGE;
+    }
+
+    // Room for the value to be read as any of the union's members, and a terminator
+    Tuple *tuple = calloc(1, sizeof(Tuple) + (length < 4 ? 4 : length) + 1);
+    tuple->key = key;
+    tuple->type = type;
+    tuple->length = length;
+    memcpy(tuple->value, value, length);
+
+    dict->tuples[dict->count++] = tuple;
+    if (dict->capacity && dict_size(dict) > dict->capacity) {
+        free(dict->tuples[--dict->count]);
+        return DICT_NOT_ENOUGH_STORAGE;
+    }
+    return DICT_OK;
+}
+
+// Numbers from PebbleKit JS arrive as 4 byte integers
+void fake_dict_add_int(DictionaryIterator *dict, uint32_t key, int32_t value) {
+    dict_add(dict, key, TUPLE_INT, &value, sizeof(value));
+}
+
+// Strings include their terminator, as on the watch
+void fake_dict_add_cstring(DictionaryIterator *dict, uint32_t key, const char *text) {
+    dict_add(dict, key, TUPLE_CSTRING, text, strlen(text) + 1);
+}
+
+void fake_dict_add_data(DictionaryIterator *dict, uint32_t key, const uint8_t *data, uint16_t size) {
+    dict_add(dict, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+void fake_dict_free(DictionaryIterator *dict) {
+    dict_clear(dict);
+    free(dict);
+}
+
+void fake_receive(DictionaryIterator *dict) {
+    if (s_inbox_count >= FAKE_INBOX_QUEUE) {
+        fprintf(stderr, "fake inbox queue full\n");
+        exit(1);
+    }
+    s_inbox[s_inbox_count++] = dict;
+    settle();
+}
+
+void fake_set_phone(FakePhone phone) {
+    s_phone = phone;
+}
+
+void fake_outbox_fail(uint8_t count) {
+    s_outbox_failures = count;
+}
+
+void fake_persist_fail_writes(int after) {
+    s_world->persist_fail_after = after;
+}
+
+static FakePersistKey *persist_find(uint32_t key) {
+    for (int i = 0; i < FAKE_PERSIST_KEYS; i++) {
+        if (s_world->persist[i].used && s_world->persist[i].key == key) {
+            return &s_world->persist[i];
+        }
+    }
+    return NULL;
+}
+
+void fake_persist_truncate(uint32_t key, uint16_t length) {
+    FakePersistKey *entry = persist_find(key);
+    if (entry && length < entry->length) {
+        s_world->stats.persist_bytes -= entry->length - length;
+        entry->length = length;
+    }
+}
+
+void fake_battery(uint8_t percent, bool charging) {
+    s_world->battery = (BatteryChargeState) { .charge_percent = percent, .is_charging = charging, .is_plugged = charging };
+    if (s_battery_handler) {
+        s_world->stats.wakeups++;
+        s_battery_handler(s_world->battery);
+        settle();
+    }
+}
+
+void fake_focus(bool in_focus) {
+    if (s_focus_handlers.will_focus) {
+        s_focus_handlers.will_focus(in_focus);
+    }
+    if (s_focus_handlers.did_focus) {
+        s_focus_handlers.did_focus(in_focus);
+    }
+    settle();
+}
+
+void fake_quiet_time(bool active) {
+    s_world->quiet = active;
+}
+
+void fake_tap(void) {
+    if (s_tap_handler) {
+        s_world->stats.wakeups++;
+        s_tap_handler(ACCEL_AXIS_Z, 1);
+        settle();
+    }
+}
+
+/*
+ * Clock and heap
+ */
+time_t fake_time(time_t *tloc) {
+    time_t now = (time_t)(s_world->now_ms / 1000);
+    if (tloc) {
+        *tloc = now;
+    }
+    return now;
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms) {
+    uint16_t ms = s_world->now_ms % 1000;
+    if (tloc) {
+        *tloc = (time_t)(s_world->now_ms / 1000);
+    }
+    if (out_ms) {
+        *out_ms = ms;
+    }
+    return ms;
+}
+
+bool clock_is_24h_style(void) {
+    return true;
+}
+
+// Each block is preceded by its size, padded to keep the block aligned
+typedef union {
+    size_t size;
+    long double align;
+} FakeBlock;
+
+void *fake_malloc(size_t size) {
+    FakeBlock *block = malloc(sizeof(FakeBlock) + size);
+    if (!block) {
+        return NULL;
+    }
+    block->size = size;
+
+    FakeStats *stats = &s_world->stats;
+    stats->allocations++;
+    stats->heap_used += size;
+    if (stats->heap_used > stats->heap_peak) {
+        stats->heap_peak = stats->heap_used;
+    }
+    return block + 1;
+}
+
+void fake_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    FakeBlock *block = (FakeBlock *)ptr - 1;
+    s_world->stats.heap_used -= block->size;
+    free(block);
+}
+
+void *fake_memcpy(void *dest, const void *src, size_t n) {
+    s_world->stats.bytes_copied += n;
+    return memcpy(dest, src, n);
+}
+
+size_t heap_bytes_used(void) {
+    return s_world->stats.heap_used;
+}
+
+size_t heap_bytes_free(void) {
+    return s_world->stats.heap_used < FAKE_HEAP_SIZE ? FAKE_HEAP_SIZE - s_world->stats.heap_used : 0;
+}
+
+/*
+ * Trig, in TRIG_MAX_ANGLE units as on the watch
+ */
+int32_t sin_lookup(int32_t angle) {
+    return (int32_t)lround(sin(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t cos_lookup(int32_t angle) {
+    return (int32_t)lround(cos(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t atan2_lookup(int16_t y, int16_t x) {
+    double angle = atan2(y, x) / (2 * M_PI) * TRIG_MAX_ANGLE;
+    return (int32_t)(angle < 0 ? angle + TRIG_MAX_ANGLE : angle);
+}
+
+/*
+ * Fonts and text
+ */
+ResHandle resource_get_handle(uint32_t resource_id) {
+    return (ResHandle)(uintptr_t)resource_id;
+}
+
+GFont fonts_load_custom_font(ResHandle handle) {
+    GFont font = fake_malloc(sizeof(struct FontInfo));
+    font->resource_id = (uint32_t)(uintptr_t)handle;
+    s_world->stats.fonts_loaded++;
+    s_world->stats.font_loads++;
+    return font;
+}
+
+void fonts_unload_custom_font(GFont font) {
+    s_world->stats.fonts_loaded--;
+    fake_free(font);
+}
+
+GSize graphics_text_layout_get_content_size(const char *text, const GFont font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment) {
+    s_world->stats.text_measures++;
+    return GSize(strlen(text) * FAKE_CHAR_WIDTH, FAKE_LINE_HEIGHT);
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment, GTextAttributes *text_attributes) {
+    s_world->stats.text_draws++;
+    record_drawn(text);
+}
+
+void graphics_context_set_text_color(GContext *ctx, GColor color) {
+    ctx->text_color = color;
+}
+
+/*
+ * Layers and windows
+ */
+static void register_layer(Layer *layer) {
+    for (int i = 0; i < FAKE_MAX_LAYERS; i++) {
+        if (!s_layers[i]) {
+            s_layers[i] = layer;
+            s_world->stats.layers_alive++;
+            return;
+        }
+    }
+    fprintf(stderr, "too many fake layers\n");
+    exit(1);
+}
+
+static void unregister_layer(Layer *layer) {
+    for (int i = 0; i < FAKE_MAX_LAYERS; i++) {
+        if (s_layers[i] == layer) {
+            s_layers[i] = NULL;
+            s_world->stats.layers_alive--;
+        } else if (s_layers[i] && s_layers[i]->parent == layer) {
+            s_layers[i]->parent = NULL;
+        }
+    }
+    s_dirty = true;
+}
+
+Layer *layer_create(GRect frame) {
+    Layer *layer = fake_malloc(sizeof(Layer));
+    memset(layer, 0, sizeof(Layer));
+    layer->frame = frame;
+    register_layer(layer);
+    return layer;
+}
+
+void layer_destroy(Layer *layer) {
+    if (layer) {
+        unregister_layer(layer);
+        fake_free(layer);
+    }
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) {
+    layer->update_proc = update_proc;
+}
+
+void layer_add_child(Layer *parent, Layer *child) {
+    child->parent = parent;
+    s_dirty = true;
+}
+
+void layer_remove_from_parent(Layer *child) {
+    child->parent = NULL;
+    s_dirty = true;
+}
+
+void layer_mark_dirty(Layer *layer) {
+    s_dirty = true;
+}
+
+GRect layer_get_bounds(const Layer *layer) {
+    return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+
+TextLayer *text_layer_create(GRect frame) {
+    TextLayer *text_layer = fake_malloc(sizeof(TextLayer));
+    memset(text_layer, 0, sizeof(TextLayer));
+    text_layer->layer.frame = frame;
+    text_layer->layer.text_layer = text_layer;
+    register_layer(&text_layer->layer);
+    return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer) {
+    if (text_layer) {
+        unregister_layer(&text_layer->layer);
+        fake_free(text_layer);
+    }
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer) {
+    return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer *text_layer, const char *text) {
+    text_layer->text = text;
+    s_dirty = true;
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font) {
+}
+
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment alignment) {
+}
+
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) {
+}
+
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) {
+}
+
+Window *window_create(void) {
+    Window *window = fake_malloc(sizeof(Window));
+    memset(window, 0, sizeof(Window));
+    window->root = layer_create(GRect(0, 0, 144, 168));
+    window->root->root_of = window;
+    return window;
+}
+
+void window_destroy(Window *window) {
+    if (window->loaded && window->handlers.unload) {
+        window->handlers.unload(window);
+    }
+    window->loaded = false;
+    if (s_window == window) {
+        s_window = NULL;
+    }
+    layer_destroy(window->root);
+    fake_free(window);
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers) {
+    window->handlers = handlers;
+}
+
+void window_set_background_color(Window *window, GColor color) {
+}
+
+Layer *window_get_root_layer(const Window *window) {
+    return window->root;
+}
+
+void window_stack_push(Window *window, bool animated) {
+    s_window = window;
+    window->loaded = true;
+    if (window->handlers.load) {
+        window->handlers.load(window);
+    }
+    s_dirty = true;
+}
+
+/*
+ * The test's scenario stands in for the event loop
+ */
+void app_event_loop(void) {
+    settle();
+    if (s_scenario) {
+        s_scenario();
+    }
+}
+
+/*
+ * Timers and services
+ */
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+    s_tick_handler = handler;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+    for (int i = 0; i < FAKE_MAX_TIMERS; i++) {
+        struct AppTimer *timer = &s_timers[i];
+        if (!timer->active) {
+            timer->due = s_world->now_ms + timeout_ms;
+            timer->order = s_timer_order++;
+            timer->callback = callback;
+            timer->data = callback_data;
+            timer->active = true;
+            s_world->stats.timers_registered++;
+            s_world->stats.timers_active++;
+            return timer;
+        }
+    }
+    return NULL;
+}
+
+void app_timer_cancel(AppTimer *timer) {
+    if (timer && timer->active) {
+        timer->active = false;
+        s_world->stats.timers_active--;
+    }
+}
+
+BatteryChargeState battery_state_service_peek(void) {
+    return s_world->battery;
+}
+
+void battery_state_service_subscribe(BatteryStateHandler handler) {
+    s_battery_handler = handler;
+}
+
+void battery_state_service_unsubscribe(void) {
+    s_battery_handler = NULL;
+}
+
+void app_focus_service_subscribe_handlers(AppFocusHandlers handlers) {
+    s_focus_handlers = handlers;
+}
+
+void app_focus_service_unsubscribe(void) {
+    memset(&s_focus_handlers, 0, sizeof(s_focus_handlers));
+}
+
+bool quiet_time_is_active(void) {
+    return s_world->quiet;
+}
+
+void accel_tap_service_subscribe(AccelTapHandler handler) {
+    s_tap_handler = handler;
+}
+
+void accel_tap_service_unsubscribe(void) {
+    s_tap_handler = NULL;
+}
+
+/*
+ * Persistent storage, limited to FAKE_PERSIST_BUDGET bytes of data
+ */
+bool persist_exists(uint32_t key) {
+    return persist_find(key) != NULL;
+}
+
+int persist_read_data(uint32_t key, void *buffer, size_t buffer_size) {
+    FakePersistKey *entry = persist_find(key);
+    if (!entry) {
+        return E_DOES_NOT_EXIST;
+    }
+    size_t size = entry->length < buffer_size ? entry->length : buffer_size;
+    memcpy(buffer, entry->data, size);
+    return (int)size;
+}
+
+int32_t persist_read_int(uint32_t key) {
+    int32_t value = 0;
+    persist_read_data(key, &value, sizeof(value));
+    return value;
+}
+
+int persist_write_data(uint32_t key, const void *data, size_t size) {
+    if (size > PERSIST_DATA_MAX_LENGTH) {
+        size = PERSIST_DATA_MAX_LENGTH;
+    }
+    if (s_world->persist_fail_after == 0) {
+        return E_OUT_OF_STORAGE;
+    }
+
+    FakePersistKey *entry = persist_find(key);
+    uint32_t old_length = entry ? entry->length : 0;
+    if (s_world->stats.persist_bytes - old_length + size > FAKE_PERSIST_BUDGET) {
+        return E_OUT_OF_STORAGE;
+    }
+    if (!entry) {
+        for (int i = 0; i < FAKE_PERSIST_KEYS && !entry; i++) {
+            if (!s_world->persist[i].used) {
+                entry = &s_world->persist[i];
+            }
+        }
+        if (!entry) {
+            return E_OUT_OF_STORAGE;
+        }
+        entry->used = true;
+        entry->key = key;
+        s_world->stats.persist_keys++;
+    }
+
+    memcpy(entry->data, data, size);
+    entry->length = size;
+    s_world->stats.persist_bytes += size - old_length;
+    s_world->stats.persist_writes++;
+    if (s_world->persist_fail_after > 0) {
+        s_world->persist_fail_after--;
+    }
+    return (int)size;
+}
+
+int persist_write_int(uint32_t key, int32_t value) {
+    return persist_write_data(key, &value, sizeof(value));
+}
+
+int persist_delete(uint32_t key) {
+    FakePersistKey *entry = persist_find(key);
+    if (!entry) {
+        return E_DOES_NOT_EXIST;
+    }
+    s_world->stats.persist_bytes -= entry->length;
+    s_world->stats.persist_keys--;
+    entry->used = false;
+    return 0;
+}
+
+/*
+ * AppMessage
+ */
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+    for (uint8_t i = 0; i < iter->count; i++) {
+        if (iter->tuples[i]->key == key) {
+            return iter->tuples[i];
+        }
+    }
+    return NULL;
+}
+
+// As packed on the wire: a count, then a 7 byte header for each tuple
+uint32_t dict_size(DictionaryIterator *iter) {
+    uint32_t size = 1;
+    for (uint8_t i = 0; i < iter->count; i++) {
+        size += 7 + iter->tuples[i]->length;
+    }
+    return size;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size) {
+    return dict_add(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+    return dict_add(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value) {
+    return dict_add(iter, key, TUPLE_UINT, &value, sizeof(value));
+}
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+    s_inbox_size = size_inbound;
+    s_outbox_size = size_outbound;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+    if (s_outbox_state != OUTBOX_IDLE) {
+        return APP_MSG_BUSY;
+    }
+    dict_clear(&s_outbox);
+    s_outbox.capacity = s_outbox_size;
+    s_outbox_state = OUTBOX_WRITING;
+    *iterator = &s_outbox;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+    if (s_outbox_state != OUTBOX_WRITING) {
+        return APP_MSG_BUSY;
+    }
+    s_outbox_state = OUTBOX_SENDING;
+    return APP_MSG_OK;
+}
+
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+    s_inbox_received = received_callback;
+}
+
+void app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback) {
+    s_inbox_dropped = dropped_callback;
+}
+
+void app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+    s_outbox_sent = sent_callback;
+}
+
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+    s_outbox_failed = failed_callback;
+}
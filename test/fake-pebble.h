@@ -0,0 +1,103 @@
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Driving the fake SDK from tests
+ *
+ * Nothing happens on its own: fake_advance moves the virtual clock on,
+ * running every timer and minute tick that falls due on the way, in order,
+ * and fake_receive hands the app a message from the phone. After each of
+ * those the fake "settles": messages the app queued are delivered (to
+ * fake_phone, if set) and acked, and dirty layers are redrawn.
+ *
+ * Persistent storage, the clock and FakeStats are shared with fake_run's
+ * child processes, so a test can run the watchface, look at what it left
+ * behind, and start it again on the same storage.
+ */
+
+#define FAKE_START_TIME 1792216800 // 2026-10-17 06:00 UTC
+#define FAKE_HEAP_SIZE 24576 // app heap on aplite, roughly
+#define FAKE_PERSIST_BUDGET 4096 // bytes of persistent storage per app
+#define FAKE_MAX_DRAWN 128 // most recent draws kept for fake_drawn
+
+typedef struct {
+    // Work done by the app
+    uint32_t wakeups; // timer callbacks, ticks and messages handed to the app
+    uint32_t timers_registered;
+    uint32_t ticks;
+    uint32_t text_measures; // graphics_text_layout_get_content_size calls
+    uint32_t text_draws;
+    uint32_t redraws; // frames: window redrawn because something was dirty
+    uint32_t allocations;
+    uint32_t bytes_copied; // by memcpy
+
+    // Memory, now and at its highest; layers and fonts count towards the heap
+    size_t heap_used;
+    size_t heap_peak;
+    uint32_t layers_alive; // layers and text layers not yet destroyed
+    uint32_t fonts_loaded; // custom fonts loaded and not yet unloaded
+    uint32_t font_loads; // every fonts_load_custom_font
+    uint32_t timers_active;
+
+    // Messages and storage
+    uint32_t messages_received;
+    uint32_t bytes_received;
+    uint32_t messages_sent;
+    uint32_t sends_failed;
+    uint32_t persist_writes;
+    uint32_t persist_bytes; // stored now, out of FAKE_PERSIST_BUDGET
+    uint32_t persist_keys;
+} FakeStats;
+
+// Phone side: sees each message the app sends, after it's acked
+typedef void (*FakePhone)(DictionaryIterator *message);
+
+extern int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+// Clear storage, stats and the drawn log, and put the clock back to FAKE_START_TIME
+void fake_reset(void);
+FakeStats *fake_stats(void);
+void fake_reset_stats(void);
+
+// Run sat-poems.c's main in a child process; scenario runs as its event loop
+// Returns the number of failed CHECKs in the child, which also count here
+int fake_run(void (*scenario)(void));
+
+uint64_t fake_now_ms(void);
+void fake_advance(uint64_t ms);
+
+// Messages from the phone: build one, then fake_receive hands it over and frees it
+DictionaryIterator *fake_dict_create(void);
+void fake_dict_add_int(DictionaryIterator *dict, uint32_t key, int32_t value);
+void fake_dict_add_cstring(DictionaryIterator *dict, uint32_t key, const char *text);
+void fake_dict_add_data(DictionaryIterator *dict, uint32_t key, const uint8_t *data, uint16_t size);
+void fake_dict_free(DictionaryIterator *dict);
+void fake_receive(DictionaryIterator *dict);
+
+void fake_set_phone(FakePhone phone);
+void fake_outbox_fail(uint8_t count); // the next count sends fail
+
+// Storage faults: every write fails once after more have succeeded (-1 for never again),
+// or a key is cut short
+void fake_persist_fail_writes(int after);
+void fake_persist_truncate(uint32_t key, uint16_t length);
+
+// Surroundings
+void fake_battery(uint8_t percent, bool charging);
+void fake_focus(bool in_focus);
+void fake_quiet_time(bool active);
+void fake_tap(void);
+
+// Was exactly text drawn (a line of the poem, or a text layer's text) since the last fake_clear_drawn?
+bool fake_drawn(const char *text);
+void fake_clear_drawn(void);
+// Is a text layer on screen showing something containing text?
+bool fake_text_shown(const char *text);
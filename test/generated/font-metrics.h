@@ -0,0 +1,15 @@
+#pragma once
+
+// Stand-in for the header the watch build generates with scripts/font-metrics.py,
+// for host builds without the fonts. Only needs to be plausible: the fake SDK
+// doesn't draw real glyphs.
+
+#define FONT_CHARIS_SIL_24_LINE_HEIGHT 24
+#define FONT_CHARIS_SIL_24_ASCENDER 20
+#define FONT_CHARIS_SIL_24_DESCENDER 6
+#define FONT_CHARIS_SIL_24_GLYPHS 197
+
+#define FONT_ANDIKA_20_LINE_HEIGHT 20
+#define FONT_ANDIKA_20_ASCENDER 15
+#define FONT_ANDIKA_20_DESCENDER 0
+#define FONT_ANDIKA_20_GLYPHS 11
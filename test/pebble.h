@@ -0,0 +1,239 @@
+#pragma once
+
+/*
+ * Just enough of the Pebble SDK to build src/c on a Linux host, unchanged
+ *
+ * Declarations match the SDK's for everything the watchface uses. The
+ * implementations in fake-pebble.c run on a virtual clock: timers, ticks and
+ * messages only happen when a test moves time on (see fake-pebble.h), and
+ * time() reads the same clock. malloc, free and memcpy are counted, so tests
+ * and benchmarks can see allocations, leaks and bytes copied.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define PBL_PLATFORM_BASALT 1
+
+// Logging
+#define APP_LOG_LEVEL_ERROR 1
+#define APP_LOG_LEVEL_WARNING 50
+#define APP_LOG_LEVEL_INFO 100
+#define APP_LOG_LEVEL_DEBUG 200
+#define APP_LOG(level, fmt, ...) printf(fmt "\n", ## __VA_ARGS__)
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+#define PBL_IF_ROUND_ELSE(a, b) (b)
+
+// Virtual clock and counted heap, see fake-pebble.c
+time_t fake_time(time_t *tloc);
+void *fake_malloc(size_t size);
+void fake_free(void *ptr);
+void *fake_memcpy(void *dest, const void *src, size_t n);
+#define time(tloc) fake_time(tloc)
+#define malloc(size) fake_malloc(size)
+#define free(ptr) fake_free(ptr)
+#define memcpy(dest, src, n) fake_memcpy(dest, src, n)
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+bool clock_is_24h_style(void);
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+
+// Trig
+#define TRIG_MAX_ANGLE 0x10000
+#define TRIG_MAX_RATIO 0xffff
+int32_t sin_lookup(int32_t angle);
+int32_t cos_lookup(int32_t angle);
+int32_t atan2_lookup(int16_t y, int16_t x);
+
+// Graphics
+typedef struct { int16_t x, y; } GPoint;
+typedef struct { int16_t w, h; } GSize;
+typedef struct { GPoint origin; GSize size; } GRect;
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GSize(w, h) ((GSize){(w), (h)})
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+
+typedef struct { uint8_t argb; } GColor;
+#define GColorWhite ((GColor){0xff})
+#define GColorBlack ((GColor){0xc0})
+#define GColorClear ((GColor){0})
+
+typedef enum { GTextAlignmentLeft, GTextAlignmentCenter, GTextAlignmentRight } GTextAlignment;
+typedef enum { GTextOverflowModeWordWrap, GTextOverflowModeTrailingEllipsis, GTextOverflowModeFill } GTextOverflowMode;
+
+typedef struct GContext GContext;
+typedef struct GTextAttributes GTextAttributes;
+typedef struct FontInfo *GFont;
+typedef void *ResHandle;
+
+enum {
+    RESOURCE_ID_FONT_CHARIS_SIL_24 = 1,
+    RESOURCE_ID_FONT_ANDIKA_20
+};
+
+ResHandle resource_get_handle(uint32_t resource_id);
+GFont fonts_load_custom_font(ResHandle handle);
+void fonts_unload_custom_font(GFont font);
+
+GSize graphics_text_layout_get_content_size(const char *text, const GFont font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment);
+void graphics_draw_text(GContext *ctx, const char *text, GFont const font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment, GTextAttributes *text_attributes);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+
+// Layers and windows
+typedef struct Layer Layer;
+typedef struct TextLayer TextLayer;
+typedef struct Window Window;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+Layer *layer_create(GRect frame);
+void layer_destroy(Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+void layer_mark_dirty(Layer *layer);
+GRect layer_get_bounds(const Layer *layer);
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment alignment);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+
+typedef void (*WindowHandler)(Window *window);
+typedef struct { WindowHandler load, appear, disappear, unload; } WindowHandlers;
+
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+void window_set_background_color(Window *window, GColor color);
+Layer *window_get_root_layer(const Window *window);
+void window_stack_push(Window *window, bool animated);
+
+void app_event_loop(void);
+
+// Timers and services
+typedef enum { SECOND_UNIT = 1, MINUTE_UNIT = 2, HOUR_UNIT = 4, DAY_UNIT = 8 } TimeUnits;
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+void app_timer_cancel(AppTimer *timer);
+
+typedef struct { uint8_t charge_percent; bool is_charging; bool is_plugged; } BatteryChargeState;
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+BatteryChargeState battery_state_service_peek(void);
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+
+typedef void (*AppFocusHandler)(bool in_focus);
+typedef struct { AppFocusHandler will_focus, did_focus; } AppFocusHandlers;
+void app_focus_service_subscribe_handlers(AppFocusHandlers handlers);
+void app_focus_service_unsubscribe(void);
+
+bool quiet_time_is_active(void);
+
+typedef enum { ACCEL_AXIS_X, ACCEL_AXIS_Y, ACCEL_AXIS_Z } AccelAxisType;
+typedef void (*AccelTapHandler)(AccelAxisType axis, int32_t direction);
+void accel_tap_service_subscribe(AccelTapHandler handler);
+void accel_tap_service_unsubscribe(void);
+
+// Persistent storage
+#define PERSIST_DATA_MAX_LENGTH 256
+#define E_DOES_NOT_EXIST (-4)
+#define E_OUT_OF_STORAGE (-7)
+
+bool persist_exists(uint32_t key);
+int persist_read_data(uint32_t key, void *buffer, size_t buffer_size);
+int32_t persist_read_int(uint32_t key);
+int persist_write_data(uint32_t key, const void *data, size_t size);
+int persist_write_int(uint32_t key, int32_t value);
+int persist_delete(uint32_t key);
+
+// AppMessage
+typedef enum { TUPLE_BYTE_ARRAY = 0, TUPLE_CSTRING = 1, TUPLE_UINT = 2, TUPLE_INT = 3 } TupleType;
+
+typedef struct {
+    uint32_t key;
+    TupleType type : 8;
+    uint16_t length;
+    union {
+        uint8_t data[0];
+        char cstring[0];
+        uint8_t uint8;
+        uint16_t uint16;
+        uint32_t uint32;
+        int8_t int8;
+        int16_t int16;
+        int32_t int32;
+    } value[];
+} Tuple;
+
+typedef struct DictionaryIterator DictionaryIterator;
+typedef enum { DICT_OK = 0, DICT_NOT_ENOUGH_STORAGE = 2 } DictionaryResult;
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+uint32_t dict_size(DictionaryIterator *iter);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+
+typedef enum {
+    APP_MSG_OK = 0,
+    APP_MSG_SEND_TIMEOUT = 2,
+    APP_MSG_SEND_REJECTED = 4,
+    APP_MSG_NOT_CONNECTED = 8,
+    APP_MSG_BUSY = 64,
+    APP_MSG_BUFFER_OVERFLOW = 128
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason, void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+void app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+void app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+
+// Message keys, as the SDK generates them from package.json
+enum {
+    MESSAGE_KEY_TITLE = 10000,
+    MESSAGE_KEY_POEM,
+    MESSAGE_KEY_POEM_LENGTH,
+    MESSAGE_KEY_POEM_SEQ,
+    MESSAGE_KEY_POEM_LOCATION,
+    MESSAGE_KEY_READY,
+    MESSAGE_KEY_POEM_VALID_FROM,
+    MESSAGE_KEY_POEM_VALID_UNTIL,
+    MESSAGE_KEY_POEM_WIRE_LENGTH,
+    MESSAGE_KEY_SAT_ELEMENTS,
+    MESSAGE_KEY_OBSERVER_LAT,
+    MESSAGE_KEY_OBSERVER_LON,
+    MESSAGE_KEY_TRACE,
+    MESSAGE_KEY_TRACE_DUMP,
+    MESSAGE_KEY_DIAGNOSTICS,
+    MESSAGE_KEY_MSG_ID,
+    MESSAGE_KEY_POEM_HASH,
+    MESSAGE_KEY_POEM_UNCHANGED,
+    MESSAGE_KEY_TIMELINE,
+    MESSAGE_KEY_POEM_RECEIVED,
+    MESSAGE_KEY_POEM_RECEIVED_HASH
+};
@@ -0,0 +1,219 @@
+#include "fake-pebble.h"
+#include "power-policy.h"
+#include "transport.h"
+
+/*
+ * Replays a recorded session through the watchface at host speed and reports
+ * what it cost per day: wakeups, timer registrations, layout calls, bytes
+ * copied and peak memory
+ *
+ *   build/replay session.log     a `pebble logs` session, see scripts/trace-report.py
+ *   build/replay                 a made up day, as run by make check
+ *
+ * From the trace we replay when the watchface was hidden and shown, battery
+ * levels, and the length of the poems it was sent. The phone here answers
+ * every request with a poem of that length, or POEM_UNCHANGED if the watch
+ * already has it.
+ */
+
+#define MAX_EVENTS 65536
+#define DAY_MS (24 * 60 * 60 * 1000ULL)
+#define HOUR_MS (60 * 60 * 1000ULL)
+#define DEFAULT_POEM_LINES 20
+
+// Must match TraceEventId in src/c/trace.h, as the events are replayed from dumps
+enum { EVENT_POEM_SET = 7, EVENT_POWER_LEVEL = 11, EVENT_VISIBILITY = 12 };
+
+typedef struct {
+    uint32_t time;
+    uint8_t id;
+    uint16_t arg;
+} Event;
+
+static Event s_events[MAX_EVENTS];
+static size_t s_num_events;
+
+static uint16_t s_poem_lines = DEFAULT_POEM_LINES;
+static uint32_t s_msg_id;
+
+/*
+ * Reading trace-record lines
+ */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static void read_record(const char *hex) {
+    uint8_t event[8];
+    size_t n = 0;
+    while (hex_digit(hex[0]) >= 0 && hex_digit(hex[1]) >= 0) {
+        event[n++] = hex_digit(hex[0]) << 4 | hex_digit(hex[1]);
+        hex += 2;
+        if (n == sizeof(event) && s_num_events < MAX_EVENTS) {
+            Event *e = &s_events[s_num_events++];
+            e->time = event[0] | event[1] << 8 | event[2] << 16 | (uint32_t)event[3] << 24;
+            e->id = event[4];
+            e->arg = event[6] | event[7] << 8;
+            n = 0;
+        }
+    }
+}
+
+static int compare_events(const void *a, const void *b) {
+    const Event *x = a, *y = b;
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    if (x->id != y->id) {
+        return x->id - y->id;
+    }
+    return x->arg - y->arg;
+}
+
+// Dumps overlap, so keep one of each event
+static void read_log(FILE *log) {
+    char line[8192];
+    while (fgets(line, sizeof(line), log)) {
+        const char *record = strstr(line, "trace-record ");
+        if (record) {
+            read_record(record + strlen("trace-record "));
+        }
+    }
+
+    qsort(s_events, s_num_events, sizeof(Event), compare_events);
+    size_t kept = 0;
+    for (size_t i = 0; i < s_num_events; i++) {
+        if (kept == 0 || compare_events(&s_events[i], &s_events[kept - 1]) != 0) {
+            s_events[kept++] = s_events[i];
+        }
+    }
+    s_num_events = kept;
+}
+
+/*
+ * A day to use without a log: up at six, battery low by the evening, hidden from ten at night
+ */
+static void make_day(void) {
+    s_events[s_num_events++] = (Event) { 0, EVENT_POWER_LEVEL, POWER_NORMAL };
+    s_events[s_num_events++] = (Event) { 12 * HOUR_MS, EVENT_POEM_SET, 40 };
+    s_events[s_num_events++] = (Event) { 12 * HOUR_MS, EVENT_POWER_LEVEL, POWER_LOW };
+    s_events[s_num_events++] = (Event) { 16 * HOUR_MS, EVENT_VISIBILITY, 0 };
+    s_events[s_num_events++] = (Event) { DAY_MS, EVENT_VISIBILITY, 1 };
+}
+
+/*
+ * The phone
+ */
+static void poem_text(char *poem, size_t size) {
+    poem[0] = '\0';
+    for (int line = 1; line <= s_poem_lines; line++) {
+        char text[16];
+        snprintf(text, sizeof(text), line == 1 ? "line %d" : "\nline %d", line);
+        if (strlen(poem) + strlen(text) >= size) {
+            break;
+        }
+        strcat(poem, text);
+    }
+}
+
+static void phone(DictionaryIterator *message) {
+    Tuple *request = dict_find(message, TRANSPORT_REQUEST_KEY);
+    if (!request) {
+        return;
+    }
+
+    static char poem[2048];
+    const char *title = "REPLAY";
+    poem_text(poem, sizeof(poem));
+
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    Tuple *hash = dict_find(message, MESSAGE_KEY_POEM_HASH);
+    if (hash && hash->value->uint32 == transport_hash(title, poem)) {
+        fake_dict_add_int(dict, MESSAGE_KEY_POEM_UNCHANGED, 1);
+        fake_receive(dict);
+        return;
+    }
+
+    uint16_t length = strlen(poem);
+    fake_dict_add_cstring(dict, MESSAGE_KEY_TITLE, title);
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_LENGTH, length);
+    fake_receive(dict);
+
+    for (uint16_t offset = 0; offset < length; offset += 200) {
+        dict = fake_dict_create();
+        fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+        fake_dict_add_int(dict, MESSAGE_KEY_POEM_SEQ, offset / 200);
+        fake_dict_add_data(dict, MESSAGE_KEY_POEM, (const uint8_t *)poem + offset,
+                length - offset < 200 ? length - offset : 200);
+        fake_receive(dict);
+    }
+}
+
+static void replay_scenario(void) {
+    fake_set_phone(phone);
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_int(dict, MESSAGE_KEY_READY, 1);
+    fake_receive(dict);
+
+    uint32_t start = s_events[0].time;
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < s_num_events; i++) {
+        const Event *event = &s_events[i];
+        fake_advance(event->time - start - elapsed);
+        elapsed = event->time - start;
+
+        switch (event->id) {
+            case EVENT_VISIBILITY:
+                fake_focus(event->arg != 0);
+                break;
+            case EVENT_POWER_LEVEL:
+                fake_battery(event->arg == POWER_CRITICAL ? SAT_BATTERY_CRITICAL - 1 :
+                        event->arg == POWER_LOW ? SAT_BATTERY_LOW - 1 : 100, false);
+                break;
+            case EVENT_POEM_SET:
+                s_poem_lines = event->arg > 0 ? event->arg : DEFAULT_POEM_LINES;
+                break;
+        }
+    }
+
+    FakeStats *stats = fake_stats();
+    double days = elapsed > 0 ? (double)elapsed / DAY_MS : 1;
+    printf("  replayed %.2f hours, per day:\n", elapsed / (double)HOUR_MS);
+    printf("  %-22s %8.0f\n", "wakeups", stats->wakeups / days);
+    printf("  %-22s %8.0f\n", "timer registrations", stats->timers_registered / days);
+    printf("  %-22s %8.0f\n", "layout calls", stats->text_measures / days);
+    printf("  %-22s %8.0f\n", "bytes copied", stats->bytes_copied / days);
+    printf("  %-22s %8.0f\n", "messages sent", stats->messages_sent / days);
+    printf("  %-22s %8.0f\n", "bytes received", stats->bytes_received / days);
+    printf("  %-22s %8d\n", "peak heap bytes", (int)stats->heap_peak);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        FILE *log = fopen(argv[1], "r");
+        if (!log) {
+            perror(argv[1]);
+            return 1;
+        }
+        read_log(log);
+        fclose(log);
+        if (s_num_events == 0) {
+            fprintf(stderr, "No trace-record lines in %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        make_day();
+    }
+
+    fake_reset();
+    fake_run(replay_scenario);
+    return test_failures ? 1 : 0;
+}
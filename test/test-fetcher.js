@@ -0,0 +1,213 @@
+// src/pkjs/fetcher.js and index.js against a stand-in poem server on
+// localhost, with the PebbleKit JS globals they use faked here. Run by the
+// Makefile: node test-fetcher.js
+
+var assert = require('assert');
+var http = require('http');
+
+var POEM = {title: "STAND-IN", poem: "a poem from the stand-in server"};
+var POEMS = JSON.stringify(POEM);
+var ETAG = '"stand-in-1"';
+var server = {requests: 0, notModified: 0, port: 0};
+
+// Just enough XMLHttpRequest for fetcher.js, sending every request to the stand-in
+function XMLHttpRequest() {
+    this.headers = {};
+}
+XMLHttpRequest.prototype.open = function(method, url) {
+    this.method = method;
+    this.path = url.replace(/^https?:\/\/[^\/]*/, '');
+};
+XMLHttpRequest.prototype.setRequestHeader = function(name, value) {
+    this.headers[name] = value;
+};
+XMLHttpRequest.prototype.getResponseHeader = function(name) {
+    return this.responseHeaders[name.toLowerCase()] || null;
+};
+XMLHttpRequest.prototype.send = function() {
+    var xhr = this;
+    var request = http.request({port: server.port, method: xhr.method, path: xhr.path, headers: xhr.headers},
+        function(response) {
+            var body = '';
+            response.on('data', function(data) { body += data; });
+            response.on('end', function() {
+                xhr.status = response.statusCode;
+                xhr.responseHeaders = response.headers;
+                xhr.responseText = body;
+                xhr.onload();
+            });
+        });
+    request.on('error', function() { xhr.onerror(); });
+    request.end();
+};
+
+var storage = {};
+global.XMLHttpRequest = XMLHttpRequest;
+global.localStorage = {
+    getItem: function(name) { return name in storage ? storage[name] : null; },
+    setItem: function(name, value) { storage[name] = String(value); }
+};
+global.navigator = {geolocation: {getCurrentPosition: function(success) {
+    setTimeout(function() {
+        success({coords: {latitude: 52.52, longitude: 13.40}});
+    }, 10);
+}}};
+
+// Messages index.js sends the watch, acked straight away
+var sent = [];
+var listeners = {};
+global.Pebble = {
+    addEventListener: function(name, listener) { listeners[name] = listener; },
+    sendAppMessage: function(dict, success) {
+        sent.push(dict);
+        setTimeout(success, 0);
+    }
+};
+
+var fetcher = require('../src/pkjs/fetcher.js');
+var transport = require('../src/pkjs/transport.js');
+require('../src/pkjs/index.js');
+
+// Make the kept responses older than RESPONSE_MAX_AGE
+function ageResponses() {
+    var responses = JSON.parse(storage.poemResponses);
+    Object.keys(responses).forEach(function(key) {
+        responses[key].time -= 60 * 60 * 1000;
+    });
+    storage.poemResponses = JSON.stringify(responses);
+}
+
+function utf8(text) {
+    return Array.prototype.slice.call(Buffer.from(text, 'utf8'));
+}
+
+// Several pings during one fetch: one request, the poems handled once, everyone told
+function testCoalesced(next) {
+    var received = [];
+    var done = [];
+    for (var i = 0; i < 3; i++) {
+        fetcher.fetchPoems(function(responseText) {
+            received.push(responseText);
+        }, function(gotPoems) {
+            done.push(gotPoems);
+            if (done.length === 3) {
+                assert.strictEqual(server.requests, 1);
+                assert.deepStrictEqual(received, [POEMS]);
+                assert.deepStrictEqual(done, [true, true, true]);
+                assert.strictEqual(fetcher.stats.coalesced, 2);
+                next();
+            }
+        });
+    }
+}
+
+// Asked again straight away, the kept response does without the server
+function testKept(next) {
+    fetcher.fetchPoems(function(responseText) {
+        assert.strictEqual(responseText, POEMS);
+        assert.strictEqual(server.requests, 1);
+        assert.strictEqual(fetcher.stats.hits, 1);
+        next();
+    });
+}
+
+// Once it's old, the server is asked again, and its 304 gets the kept body
+function testNotModified(next) {
+    ageResponses();
+    fetcher.fetchPoems(function(responseText) {
+        assert.strictEqual(responseText, POEMS);
+        assert.strictEqual(server.requests, 2);
+        assert.strictEqual(server.notModified, 1);
+        assert.strictEqual(fetcher.stats.notModified, 1);
+        next();
+    });
+}
+
+// The watch asks with the hash of the poem it has; the same poem gets a one
+// key POEM_UNCHANGED, anything else gets the poem
+function testUnchanged(next) {
+    localStorage.setItem('elementsFetched', String(Date.now()));
+    sent = [];
+    var hash = transport.contentHash(utf8(POEM.title), utf8(POEM.poem)) | 0;
+    listeners.appmessage({payload: {"POEM_HASH": hash}});
+
+    setTimeout(function() {
+        assert.strictEqual(sent.length, 1);
+        assert.deepStrictEqual(Object.keys(sent[0]).sort(), ["MSG_ID", "POEM_UNCHANGED"]);
+
+        sent = [];
+        listeners.appmessage({payload: {"POEM_HASH": hash + 1}});
+        setTimeout(function() {
+            assert.strictEqual(sent[0]["TITLE"], POEM.title);
+            assert.ok(sent.some(function(dict) { return dict["POEM"] !== undefined; }));
+            assert.strictEqual(server.requests, 2);
+            next();
+        }, 200);
+    }, 200);
+}
+
+// Satellite elements for the watch's own poems are only sent if they came
+// back whole; errors and junk are logged and skipped, and asked for again next time
+var ELEMENTS = JSON.stringify([{OBJECT_NAME: "ISS (ZARYA)", EPOCH: "2026-10-16T06:00:00", MEAN_MOTION: 15.5,
+    INCLINATION: 51.64, RA_OF_ASC_NODE: 60, ECCENTRICITY: 0.0004, ARG_OF_PERICENTER: 80.1, MEAN_ANOMALY: 0}]);
+
+function testElements(next) {
+    var answers = [[500, "{}"], [200, "not json"], [200, "{}"], [200, ELEMENTS]];
+    (function ask() {
+        var answer = answers.shift();
+        server.elementsStatus = answer[0];
+        server.elementsBody = answer[1];
+        localStorage.setItem('elementsFetched', '0');
+        sent = [];
+        listeners.appmessage({payload: {"POEM_HASH": 1}});
+        setTimeout(function() {
+            var elements = sent.filter(function(dict) { return dict["SAT_ELEMENTS"] !== undefined; });
+            if (answers.length > 0) {
+                assert.strictEqual(elements.length, 0);
+                assert.strictEqual(storage.elementsFetched, '0');
+                ask();
+                return;
+            }
+            assert.strictEqual(elements.length, 1);
+            assert.strictEqual(elements[0]["SAT_ELEMENTS"].length, 32);
+            assert.notStrictEqual(storage.elementsFetched, '0');
+            next();
+        }, 200);
+    })();
+}
+
+var standIn = http.createServer(function(request, response) {
+    server.requests++;
+    if (request.url.indexOf('/NORAD/') === 0) {
+        response.writeHead(server.elementsStatus || 404, {'Content-Type': 'application/json'});
+        response.end(server.elementsBody || '');
+        return;
+    }
+    if (request.headers['if-none-match'] === ETAG) {
+        server.notModified++;
+        response.writeHead(304);
+        response.end();
+        return;
+    }
+    response.writeHead(200, {'Content-Type': 'application/json', 'ETag': ETAG});
+    response.end(POEMS);
+});
+
+// A callback that never comes is a failure too
+setTimeout(function() {
+    console.error("test-fetcher.js: timed out");
+    process.exit(1);
+}, 5000).unref();
+
+standIn.listen(0, '127.0.0.1', function() {
+    server.port = standIn.address().port;
+    var tests = [testCoalesced, testKept, testNotModified, testUnchanged, testElements];
+    (function run() {
+        var test = tests.shift();
+        if (test) {
+            test(run);
+        } else {
+            standIn.close();
+        }
+    })();
+});
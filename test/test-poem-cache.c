@@ -0,0 +1,187 @@
+#include "fake-pebble.h"
+#include "poem-cache.h"
+#include "sat-predict.h"
+#include "timeline.h"
+
+/*
+ * The poem cache in persistent storage: round trips, what happens when
+ * storage fails or comes back short, and whether everything we keep fits
+ */
+
+// Key of a slot's first poem block, as laid out in poem-cache.c
+#define FIRST_BLOCK_KEY(slot) (POEM_CACHE_PERSIST_KEY + 1 + (slot) * (2 + POEM_CACHE_POEM_BLOCKS) + 2)
+
+#define NOW FAKE_START_TIME
+#define HOUR (60 * 60)
+
+static char s_long_poem[POEM_CACHE_MAX_POEM + 1];
+static char s_long_title[POEM_CACHE_MAX_TITLE + 1];
+
+static void fill(char *text, size_t length, char first) {
+    for (size_t i = 0; i < length; i++) {
+        text[i] = first + i % 26;
+    }
+    text[length] = '\0';
+}
+
+static bool loads(int slot, const char *title, const char *poem) {
+    char *loaded_title, *loaded_poem;
+    if (!poem_cache_load(slot, &loaded_title, &loaded_poem)) {
+        return false;
+    }
+    bool same = strcmp(loaded_title, title) == 0 && strcmp(loaded_poem, poem) == 0;
+    free(loaded_title);
+    free(loaded_poem);
+    return same;
+}
+
+static void test_round_trip(void) {
+    fake_reset();
+    poem_cache_init();
+    size_t heap = fake_stats()->heap_used;
+
+    int first = poem_cache_store("ONE", "the first poem", 0, NOW, NOW + HOUR);
+    int second = poem_cache_store(s_long_title, s_long_poem, 0, NOW + HOUR, NOW + 2 * HOUR);
+    CHECK(first >= 0 && second >= 0 && first != second);
+    CHECK(poem_cache_find(NOW) == first);
+    CHECK(poem_cache_find(NOW + HOUR) == second);
+    CHECK(poem_cache_valid_until() == NOW + 2 * HOUR);
+    CHECK(loads(second, s_long_title, s_long_poem));
+
+    // Still there when the app starts again
+    poem_cache_init();
+    CHECK(poem_cache_newest() == second);
+    CHECK(loads(first, "ONE", "the first poem"));
+
+    // Round the ring, over the oldest
+    for (int i = 0; i < POEM_CACHE_SLOTS; i++) {
+        poem_cache_store("MORE", "another poem", 0, NOW + 2 * HOUR, NOW + 3 * HOUR);
+    }
+    CHECK(poem_cache_find(NOW) < 0);
+
+    // A long poem's blocks go when a short one takes its slot
+    uint32_t keys = fake_stats()->persist_keys;
+    CHECK(keys == 1 + POEM_CACHE_SLOTS * 3);
+    CHECK(fake_stats()->heap_used == heap);
+}
+
+/*
+ * Too long a title is cut short between characters, never inside one
+ */
+static void test_long_title(void) {
+    fake_reset();
+    poem_cache_init();
+
+    // Two byte characters from the second byte on, so the cut falls inside one
+    char title[POEM_CACHE_MAX_TITLE + 8] = "A";
+    while (strlen(title) + 2 < sizeof(title)) {
+        strcat(title, "\xC3\xA9");
+    }
+    int slot = poem_cache_store(title, "a poem", 0, NOW, NOW + HOUR);
+    CHECK(slot >= 0);
+
+    char *loaded_title, *loaded_poem;
+    CHECK(poem_cache_load(slot, &loaded_title, &loaded_poem));
+    CHECK(strlen(loaded_title) == POEM_CACHE_MAX_TITLE - 1);
+    CHECK(strncmp(loaded_title, title, POEM_CACHE_MAX_TITLE - 1) == 0);
+    free(loaded_title);
+    free(loaded_poem);
+}
+
+static void test_write_failure(void) {
+    fake_reset();
+    poem_cache_init();
+    int good = poem_cache_store("GOOD", "a poem that made it", 0, NOW, NOW + HOUR);
+    FakeStats before = *fake_stats();
+
+    // The title and first block go in, the second block doesn't
+    fake_persist_fail_writes(2);
+    CHECK(poem_cache_store(s_long_title, s_long_poem, 0, NOW, NOW + 2 * HOUR) < 0);
+    fake_persist_fail_writes(-1);
+
+    // Nothing of it left behind, and the poem before is still the one for now
+    CHECK(fake_stats()->persist_bytes == before.persist_bytes);
+    CHECK(fake_stats()->persist_keys == before.persist_keys);
+    CHECK(poem_cache_newest() == good);
+    CHECK(poem_cache_find(NOW) == good);
+    CHECK(poem_cache_valid_until() == NOW + HOUR);
+
+    poem_cache_init();
+    CHECK(poem_cache_find(NOW) == good);
+}
+
+static void test_short_load(void) {
+    fake_reset();
+    poem_cache_init();
+    size_t heap = fake_stats()->heap_used;
+    int slot = poem_cache_store(s_long_title, s_long_poem, 0, NOW, NOW + HOUR);
+
+    fake_persist_truncate(FIRST_BLOCK_KEY(slot), 10);
+    char *title, *poem;
+    CHECK(!poem_cache_load(slot, &title, &poem));
+    CHECK(fake_stats()->heap_used == heap);
+
+    // And it isn't offered again
+    CHECK(poem_cache_find(NOW) < 0);
+    CHECK(poem_cache_newest() < 0);
+    CHECK(fake_stats()->persist_keys == 1);
+}
+
+static bool no_action(void) {
+    return false;
+}
+
+static uint32_t dwell(uint32_t ms) {
+    return ms;
+}
+
+static const TimelineAction s_actions[] = { NULL, no_action };
+static const TimelineHooks s_hooks = { .actions = s_actions, .num_actions = ARRAY_LENGTH(s_actions), .dwell = dwell };
+static const TimelineStep s_default_step = { 1000, 1, 0, 0, 0, 0, 0 };
+
+/*
+ * Everything we ever keep, at its largest, with room left for the storage's own bookkeeping
+ */
+static void test_budget(void) {
+    fake_reset();
+
+    poem_cache_init();
+    for (int i = 0; i < POEM_CACHE_SLOTS; i++) {
+        CHECK(poem_cache_store(s_long_title, s_long_poem, 0, NOW, NOW + HOUR) >= 0);
+    }
+
+    SatElements elements[SAT_PREDICT_MAX_SATS] = {{{0}}};
+    for (int i = 0; i < SAT_PREDICT_MAX_SATS; i++) {
+        snprintf(elements[i].name, sizeof(elements[i].name), "SAT %d", i);
+        elements[i].epoch = NOW;
+        elements[i].mean_motion = 15000000;
+    }
+    sat_predict_set_elements((const uint8_t *)elements, sizeof(elements));
+    sat_predict_set_observer(520000, 134000);
+
+    TimelineStep steps[TIMELINE_MAX_STEPS];
+    for (int i = 0; i < TIMELINE_MAX_STEPS; i++) {
+        steps[i] = s_default_step;
+        steps[i].next = (i + 1) % TIMELINE_MAX_STEPS;
+    }
+    timeline_init(&s_default_step, 1, &s_hooks);
+    CHECK(timeline_set_steps((const uint8_t *)steps, sizeof(steps)));
+    timeline_stop();
+
+    FakeStats *stats = fake_stats();
+    printf("  persist: %d bytes in %d keys at most, of %d\n",
+            (int)stats->persist_bytes, (int)stats->persist_keys, FAKE_PERSIST_BUDGET);
+    CHECK(stats->persist_bytes <= FAKE_PERSIST_BUDGET * 3 / 4);
+}
+
+int main(void) {
+    fill(s_long_poem, POEM_CACHE_MAX_POEM, 'a');
+    fill(s_long_title, POEM_CACHE_MAX_TITLE, 'A');
+
+    test_round_trip();
+    test_long_title();
+    test_write_failure();
+    test_short_load();
+    test_budget();
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+#include "fake-pebble.h"
+#include "poem-chunks.h"
+#include "poem-codec.h"
+
+/*
+ * Replays chunk streams as the phone might send them over a lossy link
+ */
+
+static char s_poem[POEM_MAX_LENGTH + 1];
+
+static void make_poem(uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        s_poem[i] = 'a' + (i * 7) % 26;
+    }
+    s_poem[length] = '\0';
+}
+
+static bool add(PoemChunks *chunks, uint8_t seq, uint16_t length) {
+    uint16_t offset = seq * POEM_CHUNK_SIZE;
+    uint16_t size = length - offset < POEM_CHUNK_SIZE ? length - offset : POEM_CHUNK_SIZE;
+    return poem_chunks_add(chunks, seq, (const uint8_t *)s_poem + offset, size);
+}
+
+// Feed chunks in the given order and check the poem comes out whole
+static void replay(uint16_t length, const uint8_t *order, uint8_t count) {
+    PoemChunks chunks = {0};
+    make_poem(length);
+    CHECK(poem_chunks_begin(&chunks, length, length));
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK(add(&chunks, order[i], length));
+        // Only whole once the last missing chunk is in
+        CHECK(poem_chunks_complete(&chunks) == (i + 1 == count));
+    }
+    CHECK(poem_chunks_complete(&chunks));
+
+    char *text = poem_chunks_take(&chunks);
+    CHECK(text && strcmp(text, s_poem) == 0);
+    free(text);
+    CHECK(chunks.text == NULL);
+}
+
+static void test_in_order(void) {
+    const uint8_t order[] = {0, 1, 2, 3};
+    replay(700, order, sizeof(order));
+}
+
+static void test_out_of_order(void) {
+    const uint8_t order[] = {3, 0, 2, 1};
+    replay(700, order, sizeof(order));
+}
+
+static void test_duplicates(void) {
+    const uint8_t order[] = {0, 0, 2, 1, 2, 3};
+    replay(700, order, sizeof(order));
+}
+
+static void test_single_chunk(void) {
+    const uint8_t order[] = {0};
+    replay(5, order, sizeof(order));
+}
+
+static void test_longest(void) {
+    uint8_t order[POEM_MAX_CHUNKS];
+    for (uint8_t i = 0; i < POEM_MAX_CHUNKS; i++) {
+        order[i] = POEM_MAX_CHUNKS - 1 - i;
+    }
+    replay(POEM_MAX_LENGTH, order, POEM_MAX_CHUNKS);
+}
+
+// A dropped chunk leaves the poem incomplete until it's sent again
+static void test_dropped(void) {
+    PoemChunks chunks = {0};
+    make_poem(700);
+    CHECK(poem_chunks_begin(&chunks, 700, 700));
+    CHECK(add(&chunks, 0, 700));
+    CHECK(add(&chunks, 1, 700));
+    CHECK(add(&chunks, 3, 700));
+    CHECK(!poem_chunks_complete(&chunks));
+    CHECK(poem_chunks_take(&chunks) == NULL);
+
+    CHECK(add(&chunks, 2, 700));
+    char *text = poem_chunks_take(&chunks);
+    CHECK(text && strcmp(text, s_poem) == 0);
+    free(text);
+}
+
+static void test_rejects(void) {
+    PoemChunks chunks = {0};
+    make_poem(700);
+
+    // Nothing begun yet
+    CHECK(!add(&chunks, 0, 700));
+
+    CHECK(!poem_chunks_begin(&chunks, 0, 0));
+    CHECK(!poem_chunks_begin(&chunks, POEM_MAX_LENGTH + 1, POEM_MAX_LENGTH + 1));
+    CHECK(!poem_chunks_begin(&chunks, 100, 200));
+
+    CHECK(poem_chunks_begin(&chunks, 700, 700));
+    // Past the end, or the wrong size for where it goes
+    CHECK(!add(&chunks, 4, 700));
+    CHECK(!poem_chunks_add(&chunks, 3, (const uint8_t *)s_poem, POEM_CHUNK_SIZE));
+    CHECK(!poem_chunks_add(&chunks, 0, (const uint8_t *)s_poem, 10));
+    CHECK(chunks.received == 0);
+    poem_chunks_reset(&chunks);
+}
+
+// A new header drops whatever was left of the poem before it
+static void test_restart(void) {
+    PoemChunks chunks = {0};
+    make_poem(700);
+    CHECK(poem_chunks_begin(&chunks, 700, 700));
+    CHECK(add(&chunks, 0, 700));
+    CHECK(add(&chunks, 1, 700));
+
+    const uint8_t order[] = {1, 0};
+    CHECK(poem_chunks_begin(&chunks, 300, 300));
+    make_poem(300);
+    for (uint8_t i = 0; i < sizeof(order); i++) {
+        CHECK(add(&chunks, order[i], 300));
+    }
+    char *text = poem_chunks_take(&chunks);
+    CHECK(text && strcmp(text, s_poem) == 0);
+    free(text);
+}
+
+// Encoded poems land at the end of the buffer and are decoded in place
+static void test_encoded(void) {
+    PoemChunks chunks = {0};
+    const char *plain = "the satellite passes overhead";
+    const uint8_t wire[] = {
+        't', 'h', 'e', ' ', POEM_CODEC_TOKEN, 7, POEM_CODEC_TOKEN, 14, ' ', POEM_CODEC_TOKEN, 9
+    };
+    CHECK(poem_chunks_begin(&chunks, strlen(plain), sizeof(wire)));
+    CHECK(poem_chunks_add(&chunks, 0, wire, sizeof(wire)));
+
+    char *text = poem_chunks_take(&chunks);
+    CHECK(text && strcmp(text, plain) == 0);
+    free(text);
+}
+
+int main(void) {
+    fake_reset();
+    size_t heap = fake_stats()->heap_used;
+
+    test_in_order();
+    test_out_of_order();
+    test_duplicates();
+    test_single_chunk();
+    test_longest();
+    test_dropped();
+    test_rejects();
+    test_restart();
+    test_encoded();
+
+    CHECK(fake_stats()->heap_used == heap);
+    return test_failures ? 1 : 0;
+}
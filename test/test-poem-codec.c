@@ -0,0 +1,113 @@
+#include "fake-pebble.h"
+#include "poem-chunks.h"
+#include "poem-codec.h"
+#include "codec-vectors.h"
+
+/*
+ * Poems encoded by the phone's codec.js come back out of poem_codec_decode
+ * byte for byte, on their own and through chunk reassembly. Also prints
+ * what the encoding saves on the wire and what decoding costs.
+ */
+
+#define DECODE_RUNS 10000
+
+static bool decode(const CodecVector *vector, char *buffer) {
+    uint16_t wire_offset = vector->length - vector->wire_length;
+    memcpy(buffer + wire_offset, vector->wire, vector->wire_length);
+    buffer[vector->length] = '\0';
+    return poem_codec_decode(buffer, vector->length, wire_offset);
+}
+
+static void test_round_trip(void) {
+    for (size_t i = 0; i < ARRAY_LENGTH(s_codec_vectors); i++) {
+        const CodecVector *vector = &s_codec_vectors[i];
+        if (!vector->wire) {
+            continue;
+        }
+        CHECK(vector->wire_length < vector->length);
+
+        char buffer[POEM_MAX_LENGTH + 1];
+        CHECK(decode(vector, buffer));
+        CHECK(strcmp(buffer, vector->plain) == 0);
+    }
+}
+
+// The way the watch really gets them: in chunks, last first
+static void test_through_chunks(void) {
+    for (size_t i = 0; i < ARRAY_LENGTH(s_codec_vectors); i++) {
+        const CodecVector *vector = &s_codec_vectors[i];
+        const char *wire = vector->wire ? vector->wire : vector->plain;
+        uint16_t wire_length = vector->wire ? vector->wire_length : vector->length;
+        if (vector->length == 0) {
+            continue;
+        }
+
+        PoemChunks chunks = {0};
+        CHECK(poem_chunks_begin(&chunks, vector->length, wire_length));
+        for (int seq = chunks.num_chunks - 1; seq >= 0; seq--) {
+            uint16_t offset = seq * POEM_CHUNK_SIZE;
+            uint16_t size = wire_length - offset < POEM_CHUNK_SIZE ? wire_length - offset : POEM_CHUNK_SIZE;
+            CHECK(poem_chunks_add(&chunks, seq, (const uint8_t *)wire + offset, size));
+        }
+
+        char *text = poem_chunks_take(&chunks);
+        CHECK(text && strcmp(text, vector->plain) == 0);
+        free(text);
+    }
+}
+
+static void test_malformed(void) {
+    char buffer[16];
+
+    // Token with nothing after it
+    memcpy(buffer, "abcd\x01", 5);
+    CHECK(!poem_codec_decode(buffer, 5, 0));
+
+    // Index past the end of the dictionary
+    memcpy(buffer, "abcd\x01\xff", 6);
+    CHECK(!poem_codec_decode(buffer, 6, 0));
+
+    // Decodes to more than the length we were told
+    memcpy(buffer + 8, "\x01\x07", 2);
+    CHECK(!poem_codec_decode(buffer, 10, 8));
+
+    // Or less
+    memcpy(buffer + 2, "ab", 2);
+    CHECK(!poem_codec_decode(buffer, 4, 2));
+}
+
+static void benchmark(void) {
+    uint32_t plain = 0, wire = 0;
+    char buffer[POEM_MAX_LENGTH + 1];
+    clock_t start = clock();
+    uint32_t decoded = 0;
+
+    for (size_t i = 0; i < ARRAY_LENGTH(s_codec_vectors); i++) {
+        const CodecVector *vector = &s_codec_vectors[i];
+        plain += vector->length;
+        wire += vector->wire ? vector->wire_length : vector->length;
+        if (!vector->wire) {
+            continue;
+        }
+        for (int run = 0; run < DECODE_RUNS; run++) {
+            decode(vector, buffer);
+        }
+        decoded++;
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("  codec: %d poems, %d bytes plain, %d on the wire (%d%%), %.2f us to decode a poem on this host\n",
+            (int)ARRAY_LENGTH(s_codec_vectors), (int)plain, (int)wire, (int)(100 * wire / plain),
+            decoded ? seconds * 1e6 / (decoded * DECODE_RUNS) : 0);
+}
+
+int main(void) {
+    fake_reset();
+
+    test_round_trip();
+    test_through_chunks();
+    test_malformed();
+    benchmark();
+
+    return test_failures ? 1 : 0;
+}
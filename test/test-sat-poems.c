@@ -0,0 +1,615 @@
+#include "fake-pebble.h"
+#include "poem-cache.h"
+#include "power-policy.h"
+#include "sat-predict.h"
+#include "timeline.h"
+#include "trace.h"
+#include "transport.h"
+
+/*
+ * The whole watchface, run by fake_run: its timeline on the virtual clock,
+ * a poem from the phone, and what it leaves behind when it exits
+ */
+
+// Default timeline, in ms from the window loading
+#define TITLE_AT 1000
+#define BLANK_AT 3500
+#define POEM_AT 4500
+#define PAGE_MS 4500
+
+static char s_poem[512];
+static uint32_t s_requests;
+static uint32_t s_msg_id;
+static uint32_t s_location; // POEM_LOCATION the phone sends, if not 0
+static uint32_t s_hash; // POEM_HASH the phone sends with a poem, if not 0
+static size_t s_heap_before;
+
+static void build_poem(void) {
+    s_poem[0] = '\0';
+    for (int line = 1; line <= 60; line++) {
+        char text[16];
+        snprintf(text, sizeof(text), line == 1 ? "line %d" : "\nline %d", line);
+        strcat(s_poem, text);
+    }
+}
+
+static void send_chunk(const char *poem, uint8_t seq) {
+    size_t length = strlen(poem);
+    size_t offset = seq * 200;
+    size_t size = length - offset < 200 ? length - offset : 200;
+
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_SEQ, seq);
+    fake_dict_add_data(dict, MESSAGE_KEY_POEM, (const uint8_t *)poem + offset, size);
+    fake_receive(dict);
+}
+
+static void send_header(const char *title, const char *poem, time_t valid_from, time_t valid_until) {
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_cstring(dict, MESSAGE_KEY_TITLE, title);
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_LENGTH, strlen(poem));
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_VALID_FROM, valid_from);
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_VALID_UNTIL, valid_until);
+    if (s_location) {
+        fake_dict_add_int(dict, MESSAGE_KEY_POEM_LOCATION, s_location);
+    }
+    if (s_hash) {
+        fake_dict_add_int(dict, MESSAGE_KEY_POEM_HASH, s_hash);
+    }
+    fake_receive(dict);
+}
+
+// Answers a poem request with an hour's poem: the header, then the chunks out of order and one twice
+static void phone(DictionaryIterator *message) {
+    if (!dict_find(message, 0)) {
+        return;
+    }
+    s_requests++;
+
+    send_header("SIXTY LINES", s_poem, FAKE_START_TIME, FAKE_START_TIME + 60 * 60);
+    send_chunk(s_poem, 2);
+    send_chunk(s_poem, 0);
+    send_chunk(s_poem, 2);
+    send_chunk(s_poem, 1);
+}
+
+// Or with two short poems, the second from ten minutes in
+static void batch_phone(DictionaryIterator *message) {
+    if (!dict_find(message, 0)) {
+        return;
+    }
+    s_requests++;
+
+    send_header("FIRST", "first poem", FAKE_START_TIME, FAKE_START_TIME + 10 * 60);
+    send_chunk("first poem", 0);
+    send_header("SECOND", "second poem", FAKE_START_TIME + 10 * 60, FAKE_START_TIME + 2 * 60 * 60);
+    send_chunk("second poem", 0);
+}
+
+static void ready(void) {
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_int(dict, MESSAGE_KEY_READY, 1);
+    if (s_location) {
+        fake_dict_add_int(dict, MESSAGE_KEY_POEM_LOCATION, s_location);
+    }
+    fake_receive(dict);
+}
+
+/*
+ * Layers exist only while they're on screen, fonts for as long as the window,
+ * and nothing outlives the app
+ */
+static void cycle_scenario(void) {
+    FakeStats *stats = fake_stats();
+
+    // Root and time, and the time and Charis fonts
+    CHECK(stats->layers_alive == 2);
+    CHECK(stats->fonts_loaded == 2);
+    CHECK(fake_text_shown("06:00"));
+
+    uint32_t wakeups = timeline_wakeups();
+    for (int cycle = 0; cycle < 3; cycle++) {
+        fake_advance(TITLE_AT);
+        CHECK(stats->layers_alive == 3);
+        CHECK(fake_text_shown("SATELLITE POEMS"));
+
+        fake_advance(BLANK_AT - TITLE_AT);
+        CHECK(stats->layers_alive == 2);
+        CHECK(!fake_text_shown("SATELLITE POEMS"));
+
+        fake_advance(POEM_AT - BLANK_AT);
+        CHECK(stats->layers_alive == 3);
+        CHECK(fake_drawn("Waiting to"));
+
+        // The waiting text fits on one page, then a blank second before starting again
+        fake_advance(PAGE_MS);
+        CHECK(stats->layers_alive == 2);
+        fake_advance(1000);
+    }
+
+    // One wakeup for each of the five steps, where polling every 500 ms took 20 a cycle
+    printf("  timeline wakeups per cycle: %d, polling every 500 ms: %d\n",
+            (int)(timeline_wakeups() - wakeups) / 3, (POEM_AT + PAGE_MS + 1000) / 500);
+    CHECK(timeline_wakeups() - wakeups == 3 * 5);
+    CHECK(stats->timers_active == 1);
+    CHECK(stats->fonts_loaded == 2);
+    CHECK(stats->font_loads == 2);
+}
+
+static void test_cycles(void) {
+    fake_reset();
+    s_heap_before = fake_stats()->heap_used;
+
+    fake_run(cycle_scenario);
+
+    FakeStats *stats = fake_stats();
+    CHECK(stats->layers_alive == 0);
+    CHECK(stats->fonts_loaded == 0);
+    CHECK(stats->timers_active == 0);
+    CHECK(stats->heap_used == s_heap_before);
+}
+
+/*
+ * A poem from the phone, scrolled a page at a time, then kept for next time
+ */
+static void poem_scenario(void) {
+    fake_set_phone(phone);
+    ready();
+    CHECK(s_requests == 1);
+
+    fake_advance(TITLE_AT);
+    CHECK(fake_text_shown("SIXTY LINES"));
+
+    fake_advance(POEM_AT - TITLE_AT);
+    CHECK(fake_drawn("line 1"));
+    CHECK(fake_drawn("line 5"));
+    CHECK(!fake_drawn("line 6"));
+
+    // The next page wipes in over a few frames
+    fake_clear_drawn();
+    fake_advance(PAGE_MS);
+    fake_advance(PAGE_MS / 10);
+    CHECK(fake_drawn("line 6"));
+    CHECK(fake_drawn("line 10"));
+    CHECK(!fake_drawn("line 11"));
+}
+
+static void restart_scenario(void) {
+    fake_set_phone(phone);
+    ready();
+    CHECK(s_requests == 0);
+
+    fake_advance(POEM_AT);
+    CHECK(fake_drawn("line 1"));
+}
+
+static void test_poem(void) {
+    fake_reset();
+    build_poem();
+    s_heap_before = fake_stats()->heap_used;
+
+    s_requests = 0;
+    fake_run(poem_scenario);
+    CHECK(fake_stats()->heap_used == s_heap_before);
+    CHECK(fake_stats()->persist_keys > 0);
+
+    // Back a minute later, when the poem in the cache is good for a while yet
+    s_requests = 0;
+    fake_advance(60 * 1000);
+    fake_run(restart_scenario);
+    CHECK(fake_stats()->heap_used == s_heap_before);
+}
+
+/*
+ * The phone gives up part way through a poem; when we next ask, we tell it
+ * which chunks we have and it sends just the rest
+ */
+static void partial_phone(DictionaryIterator *message) {
+    if (!dict_find(message, 0)) {
+        return;
+    }
+    s_requests++;
+
+    uint32_t hash = transport_hash("SIXTY LINES", s_poem);
+    s_hash = hash;
+    send_header("SIXTY LINES", s_poem, FAKE_START_TIME, FAKE_START_TIME + 60 * 60);
+    s_hash = 0;
+
+    if (s_requests == 1) {
+        CHECK(!dict_find(message, MESSAGE_KEY_POEM_RECEIVED_HASH));
+        send_chunk(s_poem, 0);
+        send_chunk(s_poem, 2);
+        return;
+    }
+
+    Tuple *received_hash = dict_find(message, MESSAGE_KEY_POEM_RECEIVED_HASH);
+    Tuple *received = dict_find(message, MESSAGE_KEY_POEM_RECEIVED);
+    CHECK(received_hash && received_hash->value->uint32 == hash);
+    CHECK(received && received->value->uint32 == ((1 << 0) | (1 << 2)));
+    send_chunk(s_poem, 1);
+}
+
+static void partial_scenario(void) {
+    fake_set_phone(partial_phone);
+    s_requests = 0;
+    ready();
+    CHECK(s_requests == 1);
+    fake_advance(POEM_AT);
+    CHECK(fake_drawn("Waiting to"));
+
+    // The rest arrives while the waiting text is up, and takes its place
+    fake_clear_drawn();
+    ready();
+    CHECK(s_requests == 2);
+    CHECK(fake_drawn("line 1"));
+}
+
+static void test_partial(void) {
+    fake_reset();
+    build_poem();
+    fake_run(partial_scenario);
+}
+
+/*
+ * Poems cached for one place are kept there, and dropped once the phone is somewhere else
+ */
+static void located_scenario(void) {
+    fake_set_phone(phone);
+    ready();
+    fake_advance(POEM_AT);
+    CHECK(fake_drawn("line 1"));
+}
+
+static void test_moved(void) {
+    fake_reset();
+    build_poem();
+    s_location = 1111;
+    fake_run(located_scenario);
+
+    // Same place: the cached poem will do
+    fake_advance(60 * 1000);
+    fake_run(restart_scenario);
+
+    // Somewhere else: it goes, and we ask for the poem for here
+    s_location = 2222;
+    fake_advance(60 * 1000);
+    fake_run(poem_scenario);
+    // Just the new poem's header, title and two blocks, and the newest slot
+    CHECK(fake_stats()->persist_keys == 4 + 1);
+    s_location = 0;
+}
+
+/*
+ * Nothing moves on to the next poem of a batch while we're hidden, until we're seen again
+ */
+static void hidden_scenario(void) {
+    fake_set_phone(batch_phone);
+    ready();
+    fake_advance(POEM_AT);
+    CHECK(fake_drawn("first poem"));
+
+    fake_advance(5 * 60 * 1000);
+    fake_focus(false);
+    fake_reset_stats();
+    fake_advance(15 * 60 * 1000);
+    CHECK(fake_stats()->allocations == 0);
+    CHECK(fake_stats()->messages_sent == 0);
+
+    // Before the next tick, a full cycle of the timeline shows the second poem
+    fake_focus(true);
+    fake_clear_drawn();
+    fake_advance(15 * 1000);
+    CHECK(fake_drawn("second poem"));
+    CHECK(!fake_drawn("first poem"));
+}
+
+static void test_hidden(void) {
+    fake_reset();
+    fake_run(hidden_scenario);
+}
+
+/*
+ * A poem too long for the cache stays up for its window, over an older one
+ * from the cache for the same time, and isn't asked for again until it runs out
+ */
+static void counting_phone(DictionaryIterator *message) {
+    if (dict_find(message, 0)) {
+        s_requests++;
+    }
+}
+
+static void uncached_scenario(void) {
+    static char long_poem[1400];
+    long_poem[0] = '\0';
+    for (int row = 1; row <= 150; row++) {
+        char text[16];
+        snprintf(text, sizeof(text), row == 1 ? "row %d" : "\nrow %d", row);
+        strcat(long_poem, text);
+    }
+    CHECK(strlen(long_poem) > POEM_CACHE_MAX_POEM);
+
+    fake_set_phone(counting_phone);
+    send_header("OLD", "old poem", FAKE_START_TIME, FAKE_START_TIME + 30 * 60);
+    send_chunk("old poem", 0);
+    send_header("LONG", long_poem, FAKE_START_TIME, FAKE_START_TIME + 3 * 60 * 60);
+    for (uint8_t seq = 0; seq * 200 < strlen(long_poem); seq++) {
+        send_chunk(long_poem, seq);
+    }
+
+    s_requests = 0;
+    ready();
+    CHECK(s_requests == 0);
+
+    fake_advance(POEM_AT);
+    CHECK(fake_drawn("row 1"));
+
+    // Past a few ticks, it's still the long one
+    int old_seconds = 0;
+    for (int second = 0; second < 5 * 60; second++) {
+        fake_clear_drawn();
+        fake_advance(1000);
+        if (fake_drawn("old poem")) {
+            old_seconds++;
+        }
+    }
+    CHECK(old_seconds == 0);
+
+    // Good for hours, so not stale at the next few refreshes
+    fake_advance(2 * 60 * 60 * 1000 - 5 * 60 * 1000);
+    CHECK(s_requests == 0);
+    fake_advance(60 * 60 * 1000);
+    CHECK(s_requests > 0);
+}
+
+static void test_uncached(void) {
+    fake_reset();
+    fake_run(uncached_scenario);
+}
+
+#if SAT_TRACE
+/*
+ * A trace dump whose message doesn't get through stops, rather than carrying
+ * on when the next poem request goes
+ */
+static uint32_t s_trace_messages;
+
+static void trace_phone(DictionaryIterator *message) {
+    if (dict_find(message, MESSAGE_KEY_TRACE) || dict_find(message, MESSAGE_KEY_TRACE_DUMP)) {
+        s_trace_messages++;
+    }
+}
+
+static void trace_scenario(void) {
+    fake_set_phone(trace_phone);
+    fake_advance(POEM_AT);
+
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_int(dict, MESSAGE_KEY_TRACE_DUMP, 1);
+    fake_outbox_fail(1);
+    fake_receive(dict);
+    CHECK(fake_stats()->sends_failed == 1);
+
+    s_trace_messages = 0;
+    ready();
+    fake_advance(60 * 1000);
+    CHECK(fake_stats()->messages_sent > 0);
+    CHECK(s_trace_messages == 0);
+}
+
+static void test_trace(void) {
+    fake_reset();
+    fake_run(trace_scenario);
+}
+#endif
+
+/*
+ * A day at one battery level, the phone sending a short poem without a window
+ * every time it's asked: the lower the battery, the less we wake and talk
+ */
+static uint8_t s_battery_percent;
+static bool s_battery_charging;
+
+static void short_poem_phone(DictionaryIterator *message) {
+    if (!dict_find(message, 0)) {
+        return;
+    }
+    s_requests++;
+
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_cstring(dict, MESSAGE_KEY_TITLE, "SHORT");
+    fake_dict_add_int(dict, MESSAGE_KEY_POEM_LENGTH, strlen("a short poem"));
+    fake_receive(dict);
+    send_chunk("a short poem", 0);
+}
+
+static void battery_day_scenario(void) {
+    fake_set_phone(short_poem_phone);
+    fake_battery(s_battery_percent, s_battery_charging);
+    ready();
+    fake_reset_stats();
+    fake_advance(24 * 60 * 60 * 1000ULL);
+}
+
+static FakeStats battery_day(uint8_t percent, bool charging) {
+    fake_reset();
+    s_battery_percent = percent;
+    s_battery_charging = charging;
+    fake_run(battery_day_scenario);
+    return *fake_stats();
+}
+
+static void test_battery_day(void) {
+    FakeStats normal = battery_day(100, false);
+    FakeStats low = battery_day(SAT_BATTERY_LOW - 1, false);
+    FakeStats critical = battery_day(SAT_BATTERY_CRITICAL - 1, false);
+    FakeStats charging = battery_day(SAT_BATTERY_CRITICAL - 1, true);
+
+    const FakeStats *days[] = { &normal, &low, &critical, &charging };
+    const char *names[] = { "normal battery", "low battery", "critical battery", "critical, charging" };
+    for (int i = 0; i < 4; i++) {
+        printf("  per day, %s: %d wakeups, %d messages sent, %d bytes received, %d redraws\n", names[i],
+                (int)days[i]->wakeups, (int)days[i]->messages_sent, (int)days[i]->bytes_received, (int)days[i]->redraws);
+    }
+
+    CHECK(normal.wakeups > low.wakeups && low.wakeups > critical.wakeups);
+    CHECK(normal.messages_sent > low.messages_sent && low.messages_sent > critical.messages_sent);
+    CHECK(normal.bytes_received > low.bytes_received && low.bytes_received > critical.bytes_received);
+
+    // On the charger, however low, we're back to full power
+    CHECK(charging.wakeups == normal.wakeups);
+    CHECK(charging.messages_sent == normal.messages_sent);
+}
+
+/*
+ * On low battery, with elements to write our own poems from, the phone's
+ * windowless poems last until the next, longer, refresh; ours never show
+ */
+static void low_battery_scenario(void) {
+    fake_set_phone(short_poem_phone);
+    fake_battery(SAT_BATTERY_LOW - 1, false);
+
+    SatElements elements = { "SAT", FAKE_START_TIME, 15500000, 9401, 10923, 26, 14582, 0, 0 };
+    DictionaryIterator *dict = fake_dict_create();
+    fake_dict_add_int(dict, MESSAGE_KEY_MSG_ID, ++s_msg_id);
+    fake_dict_add_data(dict, MESSAGE_KEY_SAT_ELEMENTS, (const uint8_t *)&elements, sizeof(elements));
+    fake_dict_add_int(dict, MESSAGE_KEY_OBSERVER_LAT, 525200);
+    fake_dict_add_int(dict, MESSAGE_KEY_OBSERVER_LON, 134050);
+    fake_receive(dict);
+
+    s_requests = 0;
+    ready();
+    fake_clear_drawn();
+    int predicted_seconds = 0;
+    for (int second = 0; second < 2 * 60 * 60; second++) {
+        fake_advance(1000);
+        if (fake_drawn("SATELLITES ABOVE")) {
+            predicted_seconds++;
+            fake_clear_drawn();
+        }
+    }
+    CHECK(predicted_seconds == 0);
+    CHECK(s_requests <= 2 * 60 / power_policy_poem_period(10) + 1);
+}
+
+static void test_low_battery(void) {
+    fake_reset();
+    fake_run(low_battery_scenario);
+}
+
+/*
+ * An hour of opening the watchface every ten minutes, say from a menu, with
+ * the phone taking a few seconds to get a poem: how long until the poem is up,
+ * and how much we talk, with the cache and with it wiped before each launch
+ */
+#define PHONE_FETCH_MS 8000
+#define LAUNCH_MINUTES 10
+
+static uint64_t s_asked_ms; // when the phone was last asked for a poem, 0 once it's answered
+static bool s_last_launch;
+static const char *s_launch_name;
+
+static void slow_phone(DictionaryIterator *message) {
+    if (dict_find(message, 0)) {
+        s_requests++;
+        s_asked_ms = fake_now_ms();
+    }
+}
+
+static void launch_scenario(void) {
+    fake_set_phone(slow_phone);
+    s_asked_ms = 0;
+    uint64_t launched = fake_now_ms();
+    fake_clear_drawn();
+    ready();
+
+    int first_poem_ms = -1;
+    for (int ms = 0; ms < 60 * 1000; ms += 100) {
+        if (s_asked_ms && fake_now_ms() - s_asked_ms >= PHONE_FETCH_MS) {
+            s_asked_ms = 0;
+            send_header("SIXTY LINES", s_poem, FAKE_START_TIME, FAKE_START_TIME + 60 * 60);
+            send_chunk(s_poem, 0);
+            send_chunk(s_poem, 1);
+            send_chunk(s_poem, 2);
+        }
+        fake_advance(100);
+        if (first_poem_ms < 0 && fake_drawn("line 1")) {
+            first_poem_ms = (int)(fake_now_ms() - launched);
+        }
+    }
+    CHECK(first_poem_ms > 0);
+    fake_advance((LAUNCH_MINUTES - 1) * 60 * 1000);
+
+    if (s_last_launch) {
+        FakeStats *stats = fake_stats();
+        printf("  per hour, %s: first poem after %d ms, %d messages sent, %d received\n", s_launch_name,
+                first_poem_ms, (int)stats->messages_sent, (int)stats->messages_received);
+    }
+}
+
+static FakeStats launch_hour(const char *name, bool cached) {
+    fake_reset();
+    build_poem();
+    s_launch_name = name;
+    for (int launch = 0; launch < 60 / LAUNCH_MINUTES; launch++) {
+        if (!cached) {
+            for (uint32_t key = POEM_CACHE_PERSIST_KEY; key <= POEM_CACHE_PERSIST_KEY + POEM_CACHE_SLOTS * (2 + POEM_CACHE_POEM_BLOCKS); key++) {
+                persist_delete(key);
+            }
+        }
+        s_last_launch = launch == 60 / LAUNCH_MINUTES - 1;
+        fake_run(launch_scenario);
+    }
+    return *fake_stats();
+}
+
+static void report_cache(void) {
+    FakeStats cached = launch_hour("with the cache", true);
+    FakeStats uncached = launch_hour("without the cache", false);
+    CHECK(cached.messages_sent < uncached.messages_sent);
+    CHECK(cached.bytes_received < uncached.bytes_received);
+}
+
+/*
+ * What an hour of showing a long poem costs
+ */
+static void hour_scenario(void) {
+    fake_set_phone(phone);
+    ready();
+    fake_reset_stats();
+    fake_advance(60 * 60 * 1000);
+
+    FakeStats *stats = fake_stats();
+    printf("  per hour: %d wakeups, %d ticks, %d allocations, %d layout measures, %d text draws, %d redraws\n",
+            (int)stats->wakeups, (int)stats->ticks, (int)stats->allocations, (int)stats->text_measures,
+            (int)stats->text_draws, (int)stats->redraws);
+
+    // The tick handler runs once a minute, not once a second
+    CHECK(stats->ticks == 60);
+}
+
+static void report_hour(void) {
+    fake_reset();
+    fake_run(hour_scenario);
+}
+
+int main(void) {
+    test_cycles();
+    test_poem();
+    test_hidden();
+    test_moved();
+    test_partial();
+    test_uncached();
+#if SAT_TRACE
+    test_trace();
+#endif
+    test_battery_day();
+    test_low_battery();
+    report_hour();
+    report_cache();
+    return test_failures ? 1 : 0;
+}
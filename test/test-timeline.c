@@ -0,0 +1,234 @@
+#include "fake-pebble.h"
+#include "timeline.h"
+
+/*
+ * Steps, repeats and skips of the timeline engine on the virtual clock
+ */
+
+enum { A_NONE, A_IN, A_OUT, A_AGAIN, A_COUNT };
+
+static char s_log[64];
+static uint8_t s_repeats_left;
+static bool s_skip;
+static uint32_t s_dwell_scale = 1;
+
+static void note(char c) {
+    size_t length = strlen(s_log);
+    if (length + 1 < sizeof(s_log)) {
+        s_log[length] = c;
+        s_log[length + 1] = '\0';
+    }
+}
+
+static bool action_in(void) {
+    note('0' + timeline_step());
+    return false;
+}
+
+static bool action_out(void) {
+    note('x');
+    return false;
+}
+
+static bool action_again(void) {
+    if (s_repeats_left == 0) {
+        return false;
+    }
+    s_repeats_left--;
+    note('+');
+    return true;
+}
+
+static const TimelineAction s_actions[A_COUNT] = {
+    [A_IN] = action_in,
+    [A_OUT] = action_out,
+    [A_AGAIN] = action_again
+};
+
+static uint32_t dwell(uint32_t ms) {
+    return ms * s_dwell_scale;
+}
+
+static bool skip(void) {
+    return s_skip;
+}
+
+static const TimelineHooks s_hooks = {
+    .actions = s_actions,
+    .num_actions = A_COUNT,
+    .dwell = dwell,
+    .skip_optional = skip
+};
+
+// Blank, an optional title, then a repeating poem, and round again
+static const TimelineStep s_steps[] = {
+    { 1000, A_IN, A_NONE, A_NONE, 1, 0, 0 },
+    { 2000, A_IN, A_OUT, A_NONE, 2, TIMELINE_OPTIONAL, 0 },
+    { 3000, A_IN, A_OUT, A_AGAIN, 0, 0, 0 }
+};
+
+static void start(void) {
+    fake_reset();
+    s_log[0] = '\0';
+    s_repeats_left = 0;
+    s_skip = false;
+    s_dwell_scale = 1;
+    timeline_init(s_steps, ARRAY_LENGTH(s_steps), &s_hooks);
+    timeline_start();
+}
+
+static void test_steps(void) {
+    start();
+    uint32_t wakeups = timeline_wakeups();
+    CHECK(strcmp(s_log, "0") == 0);
+
+    fake_advance(999);
+    CHECK(timeline_step() == 0);
+    fake_advance(1);
+    CHECK(timeline_step() == 1 && strcmp(s_log, "01") == 0);
+    fake_advance(2000);
+    CHECK(timeline_step() == 2 && strcmp(s_log, "01x2") == 0);
+    fake_advance(3000);
+    CHECK(timeline_step() == 0 && strcmp(s_log, "01x2x0") == 0);
+
+    // One timer at a time, and one wakeup per step where polling every 500 ms took 12
+    CHECK(fake_stats()->timers_active == 1);
+    CHECK(fake_stats()->wakeups == 3);
+    CHECK(timeline_wakeups() - wakeups == 3);
+    CHECK(timeline_wakeups() - wakeups < (1000 + 2000 + 3000) / 500);
+
+    timeline_stop();
+    CHECK(fake_stats()->timers_active == 0);
+}
+
+static void test_repeat(void) {
+    start();
+    s_repeats_left = 2;
+    fake_advance(1000 + 2000);
+    CHECK(timeline_step() == 2);
+    fake_advance(3000);
+    fake_advance(3000);
+    CHECK(timeline_step() == 2 && strcmp(s_log, "01x2++") == 0);
+    fake_advance(3000);
+    CHECK(timeline_step() == 0 && strcmp(s_log, "01x2++x0") == 0);
+    timeline_stop();
+}
+
+static void test_skip_optional(void) {
+    start();
+    s_skip = true;
+    fake_advance(1000);
+    CHECK(timeline_step() == 2 && strcmp(s_log, "02") == 0);
+
+    // And back again once the hook says so
+    s_skip = false;
+    fake_advance(3000 + 1000);
+    CHECK(timeline_step() == 1 && strcmp(s_log, "02x01") == 0);
+    timeline_stop();
+    CHECK(strcmp(s_log, "02x01x") == 0);
+}
+
+static void test_dwell(void) {
+    start();
+    s_dwell_scale = 3;
+    fake_advance(1000);
+    // The first step was armed before the scale changed
+    CHECK(timeline_step() == 1);
+    fake_advance(2000 * 3 - 1);
+    CHECK(timeline_step() == 1);
+    fake_advance(1);
+    CHECK(timeline_step() == 2);
+    timeline_stop();
+}
+
+static void test_pause(void) {
+    start();
+    fake_advance(500);
+    timeline_pause();
+    CHECK(fake_stats()->timers_active == 0);
+    fake_advance(60 * 60 * 1000);
+    CHECK(timeline_step() == 0);
+
+    // A full duration from the moment we resume
+    timeline_resume();
+    fake_advance(999);
+    CHECK(timeline_step() == 0);
+    fake_advance(1);
+    CHECK(timeline_step() == 1);
+    timeline_stop();
+}
+
+// A timeline from the phone while we're paused waits for us to resume
+static void test_from_phone_paused(void) {
+    start();
+    fake_advance(500);
+    timeline_pause();
+
+    TimelineStep phone[] = {
+        { 500, A_IN, A_OUT, A_NONE, 0, 0, 0 }
+    };
+    CHECK(timeline_set_steps((const uint8_t *)phone, sizeof(phone)));
+    CHECK(fake_stats()->timers_active == 0);
+    uint32_t wakeups = fake_stats()->wakeups;
+    fake_advance(60 * 60 * 1000);
+    CHECK(fake_stats()->wakeups == wakeups);
+    CHECK(strcmp(s_log, "00") == 0);
+
+    timeline_resume();
+    fake_advance(500);
+    CHECK(strcmp(s_log, "00x0") == 0);
+    timeline_stop();
+    CHECK(timeline_set_steps((const uint8_t *)phone, 0));
+}
+
+static void test_from_phone(void) {
+    start();
+    fake_advance(1000);
+
+    // Just the poem, over and over; restarts from the top and is kept
+    TimelineStep phone[] = {
+        { 500, A_IN, A_OUT, A_NONE, 0, 0, 0 }
+    };
+    CHECK(timeline_set_steps((const uint8_t *)phone, sizeof(phone)));
+    CHECK(strcmp(s_log, "01x0") == 0);
+    fake_advance(500);
+    CHECK(strcmp(s_log, "01x0x0") == 0);
+    timeline_stop();
+    CHECK(persist_exists(TIMELINE_PERSIST_KEY));
+
+    // Still there after a restart
+    s_log[0] = '\0';
+    timeline_init(s_steps, ARRAY_LENGTH(s_steps), &s_hooks);
+    timeline_start();
+    fake_advance(500);
+    CHECK(strcmp(s_log, "0x0") == 0);
+
+    // Bad ones are refused and change nothing
+    TimelineStep bad[] = {
+        { 500, A_IN, A_OUT, A_NONE, 3, 0, 0 }
+    };
+    CHECK(!timeline_set_steps((const uint8_t *)bad, sizeof(bad)));
+    CHECK(!timeline_set_steps((const uint8_t *)phone, 3));
+    bad[0].next = 0;
+    bad[0].enter = A_COUNT;
+    CHECK(!timeline_set_steps((const uint8_t *)bad, sizeof(bad)));
+
+    // Empty goes back to the default
+    CHECK(timeline_set_steps((const uint8_t *)phone, 0));
+    CHECK(!persist_exists(TIMELINE_PERSIST_KEY));
+    s_log[0] = '\0';
+    fake_advance(1000);
+    CHECK(strcmp(s_log, "1") == 0);
+    timeline_stop();
+}
+
+int main(void) {
+    test_steps();
+    test_repeat();
+    test_skip_optional();
+    test_dwell();
+    test_pause();
+    test_from_phone();
+    test_from_phone_paused();
+    return test_failures ? 1 : 0;
+}